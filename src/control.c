@@ -17,46 +17,218 @@
 #include "engine.h"
 
 #define GATE_OUTS 8
-#define MAX_PRESETS 10
+#define MAX_PRESETS (PRESET_BANKS * PRESETS_PER_BANK)
 
 #define SPEEDCYCLE 4
+#define GATECYCLE 1
 #define CLOCKOUTWIDTH 10
+#define TRIGGERWIDTH 10
+
+// gate off deadlines are kept for every gate output plus the clock output
+#define CLOCK_OUT GATE_OUTS
+
+// clock periods are kept in 1/256 ms so the average period stays exact
+#define PERIOD_SHIFT 8
+
+// external clock edges further apart than this restart tempo tracking
+#define EXTCLOCKTIMEOUT 4000
+#define MAX_CLOCK_MULT 4
+
+// only note ons of this note on this channel (16) clock, so chords, other
+// channels and a keyboard on the same port don't add or steal ticks
+#define MIDICLOCKCHANNEL 15
+#define MIDICLOCKNOTE 60
+
+#define KNOBFILTER 3
+#define KNOBDEADBAND 96
 
 #define MAX_SPEED 1000
 #define MIN_SPEED 30
 #define SINGLE_DIVISION_SPEED 62
 
+// queued presets take over on the first tick of a bar
+#define BAR_TICKS 16
+
+// STEP patterns are up to 4 pages of 16 steps, each row has its own number
+// of pages. EUCLID patterns fit on the first page
+#define STEP_PAGE 16
+#define STEP_PAGES (ENGINE_STEPS / STEP_PAGE)
+#define MAX_EUCLID_LENGTH STEP_PAGE
+
+// i2c follower protocol, the first byte is the command and 16 bit values are
+// sent high byte first. one message changes the pattern once however many
+// rows it carries
+#define I2C_ADDRESS 0x5C
+#define I2C_SET_DIVISION 0x01   // row, position 4-15
+#define I2C_SET_LOGIC 0x02      // row, logical_type, target row 1-8
+#define I2C_SET_STEPS 0x03      // row, page 0-3, pulses, long gates
+#define I2C_SET_TEMPO 0x04      // bpm
+#define I2C_SET_DIVISIONS 0x05  // position for each of the 8 rows
+#define I2C_SET_ALL_STEPS 0x06  // page 0-3, pulses for each of the 8 rows
+#define I2C_LOAD_PRESET 0x07    // preset 0-99, queued for the next bar
+#define I2C_RESET 0x08          // restart every row from the top
+#define I2C_TICK 0x20           // master tick, outputs fired, sent by a leader
+
+// a leader sends at most one tick message per I2CMININTERVAL ms, followers go
+// back to their own clock once ticks stop for EXTCLOCKTIMEOUT
+#define I2CMININTERVAL 4
+
+#define ALL_ROWS 0xFF
+#define FRAMETIME 16
+#define ARC_RINGS 4
+#define ARC_LEDS 64
+#define BLINKFRAMES 2
+
 #define B_FULL 9 
 #define B_HALF 6
 #define B_DIM 3
 
 #define SPEEDTIMER 0
 #define CLOCKTIMER 1
-#define CLOCKOUTTIMER 2
-#define GATETIMER 3
-
-preset_data_t p;
+#define GATETIMER 2
+#define RENDERTIMER 3
+#define MULTTIMER 4
+#define SAVETIMER 5
+
+// saves are written to flash in the background, once the grid, arc, front
+// button and i2c have been left alone for SAVEIDLE ms (checked every
+// SAVECYCLE). store_preset_to_flash() can only write a whole multipass slot,
+// so that is the bank in ram, written in one go
+#define SAVECYCLE 100
+#define SAVEIDLE 1000
+
+// build with -DPERF_STATS to collect tick path timing. every PERFWINDOW ms the
+// counters are printed to the debug output and shown on the DIAG page (hold
+// the front button while on the CONFIG page)
+#define PERFWINDOW 1000
+
+#ifdef PERF_STATS
+typedef struct {
+    u32 min;
+    u32 max;
+    u32 total;
+    u16 count;
+} perf_stat_t;
+
+typedef struct {
+    u32 window_start;
+    perf_stat_t step;       // cpu cycles
+    perf_stat_t render;     // cpu cycles
+    u16 clock_jitter;       // worst CLOCKTIMER deviation from its interval, ms
+    u16 gate_late;          // worst gate off edge lateness, ms
+    u16 led_writes;
+} perf_t;
+
+perf_t perf, perf_shown;
+
+#define PERF_START(v) u32 v = Get_sys_count()
+#define PERF_END(stat, v) add_perf_sample(&perf.stat, Get_sys_count() - v)
+#else
+#define PERF_START(v)
+#define PERF_END(stat, v)
+#endif
+
+pattern_t p;
+// only the bank the CONFIG page shows is kept in ram. a queued preset is
+// copied out of it, so the bar that loads it never waits on flash and picking
+// another bank before then doesn't lose it
+preset_data_t bank;
+u8 queued[PACKED_PRESET_MAX];
 preset_meta_t m;
 shared_data_t s;
 
 enum page_type page;
 
-u8 selected_row;
+u8 selected_row, front_held;
 u8 ec, do_error, do_blink_error, error_ref_row;
-u8 tickers[8];
-u8 step_ticker;
-u16 knob_position, delta;
-u8 selected_preset;
-u8 half_width_pulse;
+// knob readings are smoothed (in 1/2^KNOBFILTER units) and only taken once
+// they move further than KNOBDEADBAND from the last accepted position
+u32 knob_filtered;
+u16 knob_position;
+u8 selected_preset, selected_bank;
+u8 queued_preset;
+// slot key + 1 held to save, its release mustn't queue the slot as well
+u8 save_held;
+// slot key + 1 of a save that didn't fit in the bank, blinks with do_error
+u8 error_slot;
+
+u8 gates_high;
+u8 i2c_role;
+u32 last_i2c_send, last_i2c_tick;
+u32 last_midi_tick;
+
+// the bank in ram was saved to but isn't written to flash yet. flash is only
+// written from write_saved(), so switching to another bank meanwhile waits
+// for it in next_bank, and a preset queued from another bank isn't staged
+// until then
+u8 unsaved_bank;
+u8 next_bank;
+u8 queued_staged;
+u8 saved_preset, stored_preset_index;
+u32 last_activity;
+
+u16 half_width_pulse;
 u32 speed;
+u32 clock_period, clock_phase;
+u16 clock_interval;
+u32 clock_tick_time;
+
+// smoothed period of the external clock in 1/256 ms, 0 while not tracking
+u32 ext_period;
+u64 last_ext_clock;
+u16 tick_length;
+u8 mult_remaining;
+
+// time the current tick started, every edge of a tick is scheduled from it
+u32 tick_time;
+u32 gate_off[GATE_OUTS + 1];
+u16 gates_pending;
+
+// ratcheted and swung steps, triggers still to come within the current tick
+typedef struct {
+    u32 next;
+    u16 spacing;
+    u16 width;
+    u8 remaining;
+} sub_tick_t;
+
+sub_tick_t sub_ticks[GATE_OUTS];
+u8 sub_ticks_pending;
+u8 step_held;
+u8 euclid_key, euclid_key_row, euclid_held;
+u8 step_page;
+
+// ROTATE moves patterns to the next output up without touching them, output
+// o plays row (o + rotation) % 8
+u8 rotation;
 
 u8 logical_divisions[12] = {128, 64, 32, 16, 8, 7, 6, 5, 4, 3, 2, 1};
 
+// grid levels for the frame being rendered and as last sent to the grid, only
+// rows flagged in dirty_rows are redrawn and only LEDs that differ are sent
+u8 frame[8][16];
+u8 shadow[8][16];
+u8 dirty_rows;
+
+// arc rings show 4 rows, the half of the grid last pressed on the main page
+// (arc_half is its first output). a ring is only redrawn once its shown
+// position moves, and then only changed LEDs are sent
+u8 arc_half;
+u8 arc_shadow[ARC_RINGS][ARC_LEDS];
+u8 arc_shown[ARC_RINGS];
+u8 arc_dirty;
+
 static void step(void);
 static void output_clock(void);
 static void clock(void);
 static void update_speed_from_knob(void);
 static void update_speed(void);
+static void advance_clock(void);
+static void external_clock(void);
+static void reset_clock(void);
+static u8 is_midi_clocked(void);
+static void track_external_clock(void);
+static void update_gate_width(void);
 
 static void toggle_config_page(void);
 static void initialize_defaults(enum mode m);
@@ -66,21 +238,72 @@ static u8 get_division(u8 pos);
 static void save_preset(void);
 static void save_preset_with_confirmation(void);
 static void load_preset(u8 preset);
+static void queue_preset(u8 preset);
+static u8 stage_preset(u8 preset);
+static void select_bank(u8 b);
+static void load_bank(void);
+static void initialize_bank(void);
+static void migrate_banks(void);
+static u8 load_baseline(u8 preset, preset_data_v0_t *old);
+static void convert_baseline(preset_data_v0_t *old);
+static void write_saved(void);
+static u16 pack_preset(u8 *d);
+static void unpack_preset(u8 *d);
+static u16 get_packed_size(u8 *d);
+static u8 *get_bank_preset(u8 preset);
+static u8 put_bank_preset(u8 preset, u8 *d, u16 size);
+static u8 is_bank_valid(void);
 
 static void rotate_clocks(void);
-static void update_ticker(int r);
-static void fire_gate(u8 r, enum gate_lengths gl);
+static u8 row_of(u8 out);
+static u8 output_of(u8 r);
+static u8 to_outputs(u8 rows);
+static void fire_gates(u8 mask, u8 long_mask);
+static void set_gates(u8 mask, u8 on);
+static void schedule_sub_ticks(u8 mask, u8 long_mask);
+static void schedule_gate_off(u8 out, u32 start, u16 width);
+static void service_gates(void);
+static void report_perf(void);
+#ifdef PERF_STATS
+static void add_perf_sample(perf_stat_t *stat, u32 value);
+static void render_diag(void);
+static u8 bit_length(u32 v);
+#endif
 static void fire_error_alerts(void);
 static void set_preset_leds(void);
 
+static void process_i2c(u8 *data, u8 length);
+static void set_i2c_role(void);
+static void send_i2c_tick(void);
+static void follow_i2c_tick(u8 *data);
+static u8 is_i2c_clocked(void);
+static u16 get_u16(u8 *data);
+static void put_u16(u8 *data, u16 value);
+static u32 get_u32(u8 *data);
+static void put_u32(u8 *data, u32 value);
 static void process_grid_press(u8 x, u8 y, u8 on);
 static void process_grid_held(u8 x, u8 y);
+static void process_euclid_press(u8 x, u8 y, u8 on);
+static void generate_euclid(u8 r);
+static void process_arc(u8 enc, u8 dir);
+static u64 rotate_steps(u64 steps, u8 length, u8 dir);
+static u8 get_step_length(u8 r);
+static void set_step_pages(u8 r, u8 pages);
+static void set_page_steps(u8 r, u8 page, u16 pulse, u16 long_gate);
 static u8 set_logic_led(u8 r, u8 t); 
 static void set_glyph_leds(enum mode l);
+static void put_led(u8 x, u8 y, u8 level);
+static void flush_frame(u8 rows);
+static void invalidate_grid(void);
+static void request_refresh(u8 rows);
+static void render_timer(void);
+static u8 get_arc_row(u8 ring);
+static u8 get_arc_position(u8 r);
+static u8 is_arc_moved(void);
 
-static u8 t_logic(u8 r, u8 index);
-static u8 t_step(u8 r, u8 index);
-static u8 is_circularly_referenced(u8 r);
+static enum gate_lengths get_step_gate(u8 r, u8 index);
+static u8 is_circularly_referenced(u8 row, u8 r);
+static void update_engine(void);
 
 
 // ----------------------------------------------------------------------------
@@ -97,21 +320,18 @@ void initialize_defaults(enum mode m) {
             p.row[i].division = get_division(p.row[i].position);
             p.row[i].logic.type = NONE;
             p.row[i].logic.compared_to_row = 0;
-            p.row[i].pattern_length = p.row[i].division;
-            tickers[i] = p.row[i].pattern_length;
         }
     }
-    if (m == STEP) {
+    if (m == STEP || m == EUCLID) {
         for (u8 y = 0; y < GATE_OUTS; y++) {
-            for (u8 x = 0; x < 16; x++) {
-                p.row[y].step.pulse[x] = 0;
-                p.row[y].step.gl[x] = OFF;
-            }
-        }
-    
-        for (u8 i = 0; i < GATE_OUTS; i++) {
-            p.row[i].pattern_length = 16;
-            tickers[i] = 15;
+            p.row[y].step.pulse = 0;
+            p.row[y].step.long_gate = 0;
+            p.row[y].step.ratchet_lo = 0;
+            p.row[y].step.ratchet_hi = 0;
+            p.row[y].pages = 1;
+            p.row[y].euclid.fills = 0;
+            p.row[y].euclid.length = MAX_EUCLID_LENGTH;
+            p.row[y].euclid.rotation = 0;
         }
     }
 }
@@ -125,13 +345,9 @@ void init_presets(void) {
 
     store_shared_data_to_flash(&s);
 
-    p.config.mode = LOGICAL;
-    p.config.input_config = CLOCK;
-
-    initialize_defaults(p.config.mode);
-
-    for (u8 i = 0; i < MAX_PRESETS; i++) {
-        store_preset_to_flash(i, &m, &p);
+    for (u8 i = 0; i < PRESET_BANKS; i++) {
+        initialize_bank();
+        store_preset_to_flash(i, &m, &bank);
     }
 
     store_preset_index(0);
@@ -140,77 +356,129 @@ void init_presets(void) {
 void init_control(void) {
     // load shared data
     // load current preset and its meta data
-    for (u8 i = 0; i << 8; i++) {
-        tickers[i] = 0;
-    }
-    step_ticker = 0;
+    engine_init();
     selected_row = 0;
+    arc_half = 0;
     page = MAIN;
+    step_page = 0;
+    invalidate_grid();
+    memset(arc_shadow, 0xFF, sizeof(arc_shadow));
 
     // load_shared_data_from_flash(&s);
-    // load_preset_from_flash(0, &p);
-    load_preset(get_preset_index());
+    i2c_role = 2;
+    unsaved_bank = 0;
+    next_bank = PRESET_BANKS;
+    selected_bank = PRESET_BANKS;
+    stored_preset_index = saved_preset = get_preset_index();
+    u8 preset = get_preset_index() < MAX_PRESETS ? get_preset_index() : 0;
+    migrate_banks();
+    stage_preset(preset);
+    load_preset(preset);
 
     // set up any other initial values and timers
-    add_timed_event(CLOCKTIMER, 100, 1);
+    clock_interval = 100;
+    add_timed_event(CLOCKTIMER, clock_interval, 1);
 
     update_speed_from_knob();
 
     add_timed_event(SPEEDTIMER, SPEEDCYCLE, 1);
+    add_timed_event(GATETIMER, GATECYCLE, 1);
+    add_timed_event(RENDERTIMER, FRAMETIME, 1);
+    add_timed_event(SAVETIMER, SAVECYCLE, 1);
 }
 
 void process_event(u8 event, u8 *data, u8 length) {
     switch (event) {
         case MAIN_CLOCK_RECEIVED:
             if (p.config.input_config == CLOCK && data[1]) {
-                step();
+                external_clock();
             } else if (p.config.input_config == ROTATE && data[1]) {
                 rotate_clocks();
+            } else if (p.config.input_config == RESET && data[1]) {
+                reset_clock();
             }
             break;
         
         case MAIN_CLOCK_SWITCHED:
+            ext_period = 0;
+            mult_remaining = 0;
+            update_gate_width();
             break;
     
         case GATE_RECEIVED:
             break;
         
         case GRID_CONNECTED:
+            invalidate_grid();
             break;
         
         case GRID_KEY_PRESSED:
+            last_activity = get_global_time();
             process_grid_press(data[0], data[1], data[2]);
+            update_engine();
+            request_refresh(ALL_ROWS);
             break;
     
         case GRID_KEY_HELD:
+            last_activity = get_global_time();
             process_grid_held(data[0], data[1]);
             break;
             
         case ARC_ENCODER_COARSE:
+            last_activity = get_global_time();
+            process_arc(data[0], data[1]);
             break;
     
         case FRONT_BUTTON_PRESSED:
-            if (!data[0]) toggle_config_page();
+            last_activity = get_global_time();
+            if (!data[0]) {
+                if (front_held) front_held = 0; else toggle_config_page();
+            }
+            request_refresh(ALL_ROWS);
             break;
     
         case FRONT_BUTTON_HELD:
+            last_activity = get_global_time();
+            if (page == MAIN) {
+                page = CHANCE;
+                front_held = 1;
+                request_refresh(ALL_ROWS);
+            }
+#ifdef PERF_STATS
+            if (page == CONFIG) {
+                page = DIAG;
+                front_held = 1;
+                request_refresh(ALL_ROWS);
+            }
+#endif
             break;
     
         case BUTTON_PRESSED:
             break;
     
         case I2C_RECEIVED:
+            process_i2c(data, length);
             break;
             
         case TIMED_EVENT:
             if (data[0] == SPEEDTIMER) {
                 update_speed_from_knob();
+                report_perf();
             } else if (data[0] == CLOCKTIMER) {
-                if (!is_external_clock_connected() || p.config.input_config == ROTATE) step();
-            } else if (data[0] == CLOCKOUTTIMER) {
-                set_clock_output(0);
-            } else if (data[0] >= GATETIMER) {
-                set_gate(data[0] - GATETIMER, 0);
+                advance_clock();
+                if ((!is_external_clock_connected() || p.config.input_config != CLOCK) && !is_i2c_clocked() && !is_midi_clocked()) step();
+            } else if (data[0] == MULTTIMER) {
+                if (mult_remaining && p.config.input_config == CLOCK) {
+                    mult_remaining--;
+                    step();
+                    if (mult_remaining) add_timed_event(MULTTIMER, tick_length, 0);
+                }
+            } else if (data[0] == RENDERTIMER) {
+                render_timer();
+            } else if (data[0] == GATETIMER) {
+                service_gates();
+            } else if (data[0] == SAVETIMER) {
+                write_saved();
             }
             break;
         
@@ -218,6 +486,13 @@ void process_event(u8 event, u8 *data, u8 length) {
             break;
         
         case MIDI_NOTE:
+            // midi clock isn't passed on by multipass, a note on (a track of
+            // 16ths from a sequencer say) clocks like the input jack instead
+            if (data[0] != MIDICLOCKCHANNEL || data[1] != MIDICLOCKNOTE) break;
+            if (p.config.input_config == CLOCK && data[2] && !is_external_clock_connected()) {
+                last_midi_tick = get_global_time();
+                external_clock();
+            }
             break;
         
         case MIDI_CC:
@@ -249,101 +524,457 @@ u8 get_division(u8 pos) {
 
 void save_preset_with_confirmation() {
     save_preset();
-    refresh_grid();
+    request_refresh(ALL_ROWS);
 }
 
 void save_preset() {
-    store_preset_to_flash(selected_preset, &m, &p);
-    store_shared_data_to_flash(&s);
-    store_preset_index(selected_preset);
+    // only staged in the ram copy of the bank, write_saved() commits it later
+    u8 packed[PACKED_PRESET_MAX];
+    u16 size = pack_preset(packed);
+    u8 index = selected_preset % PRESETS_PER_BANK;
+
+    u8 *slot = get_bank_preset(index);
+    if (size != get_packed_size(slot) || memcmp(slot, packed, size)) {
+        if (!put_bank_preset(index, packed, size)) {
+            // the slot keeps what it had and blinks
+            do_error = 1;
+            error_slot = index + 4;
+            return;
+        }
+        unsaved_bank = 1;
+    }
+    if (queued_preset == selected_preset) memcpy(queued, packed, size);
+
+    saved_preset = selected_preset;
+}
+
+void write_saved() {
+    // shared data never changes after init_presets, so only banks and the
+    // index are written, each one only when it differs from flash
+    if (get_global_time() - last_activity < SAVEIDLE) return;
+
+    if (unsaved_bank) {
+        store_preset_to_flash(selected_bank, &m, &bank);
+        unsaved_bank = 0;
+
+        // a switch that waited for the write goes ahead now, staging the
+        // queued preset picks its bank, so the bank asked for goes last
+        u8 b = next_bank;
+        if (queued_preset < MAX_PRESETS && !queued_staged) queued_staged = stage_preset(queued_preset);
+        if (b < PRESET_BANKS) select_bank(b);
+        request_refresh(ALL_ROWS);
+        return;
+    }
+
+    if (stored_preset_index != saved_preset) {
+        store_preset_index(saved_preset);
+        stored_preset_index = saved_preset;
+    }
 }
 
 void load_preset(u8 preset) {
+    // from the copy stage_preset() made, so this only costs an unpack
     selected_preset = preset;
-    load_preset_from_flash(selected_preset, &p);
+    queued_preset = MAX_PRESETS;
+    engine_set_seed(preset + 1);
+    unpack_preset(queued);
 
-    refresh_grid();
+    request_refresh(ALL_ROWS);
 }
 
-void step() {
-    output_clock();
-    clock();
-    fire_error_alerts();
-    refresh_grid();
+void queue_preset(u8 preset) {
+    // switched on the next bar so a live change stays on the beat, tapping a
+    // queued slot again switches right away
+    if (preset == queued_preset) {
+        if (queued_staged) load_preset(preset);
+        return;
+    }
+
+    queued_preset = preset;
+    queued_staged = stage_preset(preset);
+    request_refresh(ALL_ROWS);
 }
 
-void clock() {
+u8 stage_preset(u8 preset) {
+    // a preset from another bank costs reading that bank from flash, or has
+    // to wait for a pending save, see select_bank()
+    select_bank(preset / PRESETS_PER_BANK);
+    if (selected_bank != preset / PRESETS_PER_BANK) return 0;
+
+    u8 *d = get_bank_preset(preset % PRESETS_PER_BANK);
+    memcpy(queued, d, get_packed_size(d));
+    return 1;
+}
+
+void select_bank(u8 b) {
+    // the bank in ram is swapped for another one read from flash. the one
+    // being left may still have a save waiting on write_saved(), then the
+    // switch waits for it too
+    if (b == selected_bank) {
+        next_bank = PRESET_BANKS;
+        return;
+    }
+
+    if (unsaved_bank) {
+        next_bank = b;
+        return;
+    }
+
+    next_bank = PRESET_BANKS;
+    selected_bank = b;
+    load_bank();
+}
+
+void load_bank() {
+    load_preset_from_flash(selected_bank, &bank);
+
+    // a bank that was never written in this layout is started over
+    if (bank.version != PRESET_VERSION || !is_bank_valid()) initialize_bank();
+}
+
+u8 is_bank_valid() {
+    // every preset has to end inside the bank, so walking it stays in there
+    u16 at = 0;
+    for (u8 i = 0; i < PRESETS_PER_BANK; i++) {
+        if (at + PACKED_PRESET_MIN > sizeof(bank.data)) return 0;
+        at += get_packed_size(&bank.data[at]);
+    }
+    return at <= sizeof(bank.data);
+}
+
+u8 *get_bank_preset(u8 preset) {
+    // presets follow each other in order, preset PRESETS_PER_BANK is where
+    // the free space starts
+    u8 *d = bank.data;
+    while (preset--) d += get_packed_size(d);
+    return d;
+}
+
+u8 put_bank_preset(u8 preset, u8 *d, u16 size) {
+    // the presets after it move to make room or close up, the free space is
+    // kept cleared so a bank saved the same compares equal
+    u8 *slot = get_bank_preset(preset);
+    u8 *end = get_bank_preset(PRESETS_PER_BANK);
+    u16 old_size = get_packed_size(slot);
+
+    if (end - bank.data - old_size + size > sizeof(bank.data)) return 0;
+
+    memmove(slot + size, slot + old_size, end - slot - old_size);
+    memcpy(slot, d, size);
+    if (size < old_size) memset(end - old_size + size, 0, old_size - size);
+    return 1;
+}
+
+u16 get_packed_size(u8 *d) {
+    u16 size = PACKED_PRESET_MIN;
     for (u8 i = 0; i < GATE_OUTS; i++) {
-        tickers[i] = (tickers[i] + 1) % p.row[i].pattern_length;
+        for (u8 stored = d[PACKED_HEADER + i * PACKED_ROW + 4]; stored; stored >>= 1) {
+            if (stored & 1) size += PACKED_PAGE;
+        }
+    }
+    return size;
+}
+
+void migrate_banks() {
+    // the first release kept one unpacked preset to a multipass slot and no
+    // version. its 10 presets come over as bank 0, the other banks start
+    // over. with multipass keeping slots in an array of preset_data_t the old
+    // presets now sit closer together than banks do, within the first few
+    // slots, so bank 0 is put together in the last slot, which they never
+    // reach, and only copied over once every old preset has been read
+    preset_data_v0_t old;
+    if (!load_baseline(0, &old)) return;
+
+    u8 current_rotation = rotation;
+    rotation = 0;
+    initialize_bank();
+    store_preset_to_flash(PRESET_BANKS - 1, &m, &bank);
+
+    for (u8 i = 0; i < PRESETS_PER_BANK; i++) {
+        if (!load_baseline(i, &old)) continue;
+
+        // one page of steps always fits
+        convert_baseline(&old);
+        load_preset_from_flash(PRESET_BANKS - 1, &bank);
+        put_bank_preset(i, queued, pack_preset(queued));
+        store_preset_to_flash(PRESET_BANKS - 1, &m, &bank);
+    }
+
+    load_preset_from_flash(PRESET_BANKS - 1, &bank);
+    store_preset_to_flash(0, &m, &bank);
+
+    initialize_bank();
+    for (u8 b = 1; b < PRESET_BANKS; b++) {
+        store_preset_to_flash(b, &m, &bank);
+    }
+    rotation = current_rotation;
+}
+
+u8 load_baseline(u8 preset, preset_data_v0_t *old) {
+    // gathered from the slots it straddles now, read through the bank. every
+    // preset of the first release starts with the division table, which no
+    // bank has where its config would be
+    for (u16 copied = 0; copied < sizeof(*old);) {
+        u32 at = (u32)preset * sizeof(*old) + copied;
+        u16 offset = at % sizeof(preset_data_t);
+        u16 n = sizeof(preset_data_t) - offset;
+        if (n > sizeof(*old) - copied) n = sizeof(*old) - copied;
+
+        load_preset_from_flash(at / sizeof(preset_data_t), &bank);
+        memcpy((u8 *)old + copied, (u8 *)&bank + offset, n);
+        copied += n;
+    }
+
+    return !memcmp(old->config.clock_divs, logical_divisions, sizeof(logical_divisions))
+        && old->config.mode <= STEP && old->config.input_config <= ROTATE;
+}
 
-        if (p.config.mode == LOGICAL && t_logic(i, tickers[i])) {
-            fire_gate(i, SHORT);
-        } else if (p.config.mode == STEP && t_step(i, tickers[i])) {
-            fire_gate(i, p.row[i].step.gl[tickers[i]]);
+void convert_baseline(preset_data_v0_t *old) {
+    // into the live pattern, ready to be packed. steps become the first page,
+    // everything the first release didn't have gets its default
+    p.config.mode = old->config.mode;
+    p.config.input_config = old->config.input_config;
+    p.config.clock_mult = 1;
+    p.config.swing = 0;
+    p.config.i2c_leader = 0;
+
+    for (u8 r = 0; r < GATE_OUTS; r++) {
+        row_params_v0_t *old_row = &old->row[r];
+        row_params_t *row = &p.row[r];
+
+        row->position = old_row->position > 3 && old_row->position < 16 ? old_row->position : 15 - r;
+        row->logic.type = old_row->logic.compared_to_row > 0 && old_row->logic.compared_to_row <= GATE_OUTS
+            && old_row->logic.type <= NOR ? old_row->logic.type : NONE;
+        row->logic.compared_to_row = row->logic.type == NONE ? 0 : old_row->logic.compared_to_row;
+        row->chance = ENGINE_ALWAYS;
+        row->euclid.fills = 0;
+        row->euclid.length = MAX_EUCLID_LENGTH;
+        row->euclid.rotation = 0;
+        memset(&row->step, 0, sizeof(row->step));
+        row->pages = 1;
+
+        for (u8 x = 0; x < STEP_PAGE; x++) {
+            if (old_row->step.pulse[x] != 1) continue;
+            row->step.pulse |= 1 << x;
+            if (old_row->step.gl[x] == LONG) row->step.long_gate |= 1 << x;
         }
     }
+}
+
+void initialize_bank() {
+    // defaults are built in the live pattern, keep whatever is playing
+    pattern_t current = p;
+    u8 current_rotation = rotation;
+    rotation = 0;
+
+    p.config.mode = LOGICAL;
+    p.config.input_config = CLOCK;
+    p.config.clock_mult = 1;
+    p.config.swing = 0;
+    p.config.i2c_leader = 0;
+
+    initialize_defaults(LOGICAL);
+    initialize_defaults(STEP);
+    for (u8 i = 0; i < GATE_OUTS; i++) {
+        p.row[i].chance = ENGINE_ALWAYS;
+    }
+
+    memset(&bank, 0, sizeof(bank));
+    bank.version = PRESET_VERSION;
+    u8 *d = bank.data;
+    for (u8 i = 0; i < PRESETS_PER_BANK; i++) {
+        d += pack_preset(d);
+    }
 
-    step_ticker = (step_ticker + 1) % 16;
+    p = current;
+    rotation = current_rotation;
 }
 
-void rotate_clocks() {
-    if (p.config.mode == LOGICAL) {
-        u8 next_position = 0;
-        u8 first_pos = p.row[0].position;
-        u8 first_div = get_division(first_pos);
-        u8 first_length = first_div;
+u16 pack_preset(u8 *d) {
+    // only the row's pages that have steps are stored, and their ratchets
+    // only if they have any. returns the size
+    d[0] = p.config.mode | (rotation << 2);
+    d[1] = (p.config.input_config == ROTATE ? 2 : p.config.input_config == RESET ? 1 : 0)
+        | ((p.config.clock_mult ? p.config.clock_mult - 1 : 0) << 2) | ((p.config.swing & 7) << 4) | (p.config.i2c_leader ? 0x80 : 0);
 
-        for (u8 i = 0; i < GATE_OUTS; i++) {
-            next_position = (next_position + 1) % GATE_OUTS;
-            if (next_position == 0) {
-                p.row[7].position = first_pos;
-                p.row[7].division = first_div;
-                p.row[7].pattern_length = first_length;
-            } else {
-                p.row[i].position = p.row[next_position].position;
-                p.row[i].division = get_division(p.row[i].position);
-                p.row[i].pattern_length = p.row[i].division;
-            }
+    u8 *at = d + PACKED_PRESET_MIN;
+    for (u8 i = 0; i < GATE_OUTS; i++) {
+        u8 *row = d + PACKED_HEADER + i * PACKED_ROW;
+        step_t *st = &p.row[i].step;
+        u8 stored = 0;
+
+        put_u16(row, p.row[i].euclid.fills | ((p.row[i].euclid.length - 1) << 5) | (p.row[i].euclid.rotation << 9)
+            | ((p.row[i].pages - 1) << 13));
+        row[2] = p.row[i].position | ((ENGINE_ALWAYS - p.row[i].chance) << 4);
+        row[3] = (p.row[i].logic.type << 4) | (p.row[i].logic.compared_to_row & 0xF);
+
+        for (u8 page = 0; page < p.row[i].pages; page++) {
+            u8 shift = page * STEP_PAGE;
+            u16 pulse = st->pulse >> shift;
+            u16 ratchet_lo = st->ratchet_lo >> shift;
+            u16 ratchet_hi = st->ratchet_hi >> shift;
+            if (!pulse) continue;
+
+            stored |= 1 << page;
+            put_u16(at, pulse);
+            put_u16(at + 2, st->long_gate >> shift);
+            at += PACKED_PAGE;
+
+            if (!(ratchet_lo | ratchet_hi)) continue;
+            stored |= 0x10 << page;
+            put_u16(at, ratchet_lo);
+            put_u16(at + 2, ratchet_hi);
+            at += PACKED_PAGE;
         }
-    } else if (p.config.mode == STEP) {
-        u8 next_position = 0;
-        u8 first_gl[16];
-        u8 first_pulse[16];
+        row[4] = stored;
+    }
+
+    return at - d;
+}
+
+void unpack_preset(u8 *d) {
+    p.config.mode = (d[0] & 3) <= EUCLID ? d[0] & 3 : LOGICAL;
+    rotation = (d[0] >> 2) & 7;
+    p.config.input_config = d[1] & 2 ? ROTATE : d[1] & 1 ? RESET : CLOCK;
+    p.config.clock_mult = ((d[1] >> 2) & 3) + 1;
+    p.config.swing = (d[1] >> 4) & 7;
+    p.config.i2c_leader = d[1] >> 7;
+    update_gate_width();
+    set_i2c_role();
+
+    for (u8 i = 0; i < 12; i++) {
+        p.config.clock_divs[i] = logical_divisions[i];
+    }
 
-        for (u8 i = 0; i < 16; i++) {
-            first_gl[i] = p.row[0].step.gl[i];
-            first_pulse[i] = p.row[0].step.pulse[i];
+    u8 *at = d + PACKED_PRESET_MIN;
+    for (u8 i = 0; i < GATE_OUTS; i++) {
+        u8 *row = d + PACKED_HEADER + i * PACKED_ROW;
+        u16 euclid = get_u16(row);
+        u8 position = row[2] & 0xF;
+        u8 target = row[3] & 0xF;
+
+        p.row[i].position = position > 3 && position < 16 ? position : 15 - i;
+        p.row[i].division = get_division(p.row[i].position);
+        p.row[i].logic.type = target > 0 && target <= GATE_OUTS ? row[3] >> 4 : NONE;
+        p.row[i].logic.compared_to_row = p.row[i].logic.type == NONE ? 0 : target;
+        p.row[i].chance = ENGINE_ALWAYS - (row[2] >> 4);
+        p.row[i].blink = 0;
+
+        step_t *st = &p.row[i].step;
+        memset(st, 0, sizeof(*st));
+        for (u8 page = 0; page < STEP_PAGES; page++) {
+            u8 shift = page * STEP_PAGE;
+            if (!((row[4] >> page) & 1)) continue;
+
+            st->pulse |= (u64)get_u16(at) << shift;
+            st->long_gate |= (u64)get_u16(at + 2) << shift;
+            at += PACKED_PAGE;
+
+            if (!((row[4] >> (4 + page)) & 1)) continue;
+            st->ratchet_lo |= (u64)get_u16(at) << shift;
+            st->ratchet_hi |= (u64)get_u16(at + 2) << shift;
+            at += PACKED_PAGE;
         }
+        st->long_gate &= st->pulse;
+        st->ratchet_lo &= st->pulse;
+        st->ratchet_hi &= st->pulse;
+        set_step_pages(i, ((euclid >> 13) & 3) + 1);
+
+        euclid_t *eu = &p.row[i].euclid;
+        eu->length = ((euclid >> 5) & 0xF) + 1;
+        eu->fills = euclid & 0x1F;
+        eu->rotation = (euclid >> 9) & 0xF;
+        if (p.config.mode == EUCLID) generate_euclid(i);
+    }
 
+    update_engine();
+}
+
+void step() {
+    PERF_START(cycles);
+    tick_time = get_global_time();
+
+    output_clock();
+    clock();
+    if (p.config.i2c_leader) send_i2c_tick();
+    fire_error_alerts();
+
+    PERF_END(step, cycles);
+}
+
+void clock() {
+    // drive the outputs prepared on the previous tick first, the bookkeeping
+    // and evaluation of the next tick happen after the edge is out
+    u8 long_gates = to_outputs(engine_get_long_gates());
+    fire_gates(to_outputs(engine_get_outputs()), long_gates);
+    if (engine_get_sub_ticks()) schedule_sub_ticks(to_outputs(engine_get_sub_ticks()), long_gates);
+
+    engine_tick();
+
+    // a queued preset replaces the pattern prepared for the top of the bar,
+    // it's already in ram so this costs an unpack
+    if (queued_preset < MAX_PRESETS && queued_staged && (engine_get_tick() + 1) % BAR_TICKS == 0) {
+        load_preset(queued_preset);
+        return;
+    }
+
+    // the playhead only changes STEP rows with a step under its old or new
+    // column, EUCLID rows show their length so always change
+    if (p.config.mode == STEP) {
         for (u8 i = 0; i < GATE_OUTS; i++) {
-            next_position = (next_position + 1) % GATE_OUTS;
-            if (next_position == 0) {
-                for (u8 j = 0; j < 16; j++) {
-                    p.row[7].step.gl[j] = first_gl[j];
-                    p.row[7].step.pulse[j] = first_pulse[j];
-                }
-            } else {
-                for (u8 j = 0; j < 16; j++) {
-                    p.row[i].step.gl[j] = p.row[next_position].step.gl[j];
-                    p.row[i].step.pulse[j] = p.row[next_position].step.pulse[j];
-                }
+            if (((p.row[i].step.pulse >> engine_get_position(i)) | (p.row[i].step.pulse >> engine_get_step(i))) & 1) {
+                dirty_rows |= 1 << output_of(i);
             }
         }
+    } else if (p.config.mode == EUCLID) {
+        dirty_rows = ALL_ROWS;
     }
-    refresh_grid();
 }
 
-void fire_gate(u8 r, enum gate_lengths gl) {
-    if (gl == LONG) {
-        // 50% width pulse for LONG gates
-        add_timed_event(GATETIMER + r, half_width_pulse, 0);
-    } else if (gl == SHORT) {
-        // 10ms triggers for SHORT
-        add_timed_event(GATETIMER + r, 10, 0);
+void rotate_clocks() {
+    // rows and their logic targets stay as they are, only which output and
+    // grid row shows them moves, so nothing needs recompiling
+    rotation = (rotation + 1) % GATE_OUTS;
+    request_refresh(ALL_ROWS);
+}
+
+u8 row_of(u8 out) {
+    return (out + rotation) % GATE_OUTS;
+}
+
+u8 output_of(u8 r) {
+    return (r + GATE_OUTS - rotation) % GATE_OUTS;
+}
+
+u8 to_outputs(u8 rows) {
+    // bit r of rows moves to bit output_of(r), a byte rotate
+    return rotation ? (rows >> rotation) | (rows << (GATE_OUTS - rotation)) : rows;
+}
+
+void fire_gates(u8 mask, u8 long_mask) {
+    // all rising edges of the tick go out back to back, before any of the
+    // per row bookkeeping
+    set_gates(mask, 1);
+
+    for (u8 r = 0; r < GATE_OUTS; r++) {
+        if (!(mask & (1 << r))) continue;
+
+        // 50% width pulse for LONG gates, 10ms triggers for SHORT
+        schedule_gate_off(r, tick_time, long_mask & (1 << r) ? half_width_pulse : TRIGGERWIDTH);
+
+        // latched for BLINKFRAMES frames so gates between frames are still seen
+        p.row[row_of(r)].blink = BLINKFRAMES;
+    }
+
+    dirty_rows |= mask;
+}
+
+void set_gates(u8 mask, u8 on) {
+    gates_high = on ? gates_high | mask : gates_high & ~mask;
+
+    for (u8 r = 0; mask; r++, mask >>= 1) {
+        if (mask & 1) set_gate(r, on);
     }
-    
-    set_gate(r, 1);
-    p.row[r].blink = 1;
 }
 
 void fire_error_alerts() {
@@ -354,8 +985,11 @@ void fire_error_alerts() {
             do_error = 0;
             do_blink_error = 0;
             error_ref_row = 0;
+            error_slot = 0;
+            dirty_rows = ALL_ROWS;
         } else {
             do_blink_error = ec % 2 == 0 ? 0 : 1;
+            dirty_rows |= 1 << output_of(error_ref_row > 0 ? error_ref_row - 1 : selected_row);
         }
     }
 }
@@ -363,19 +997,26 @@ void fire_error_alerts() {
 void update_speed_from_knob() {
     if (get_knob_count() == 0) return;
 
-    // this stuff doesn't work :(
-    if (get_knob_value(0) != knob_position) {
-        delta = knob_position > get_knob_value(0) ? knob_position - get_knob_value(0) : get_knob_value(0) - knob_position;
-    }
+    // one pole low pass, the first reading is taken as is
+    u16 raw = get_knob_value(0);
+    if (!knob_filtered) knob_filtered = (u32)raw << KNOBFILTER;
+    knob_filtered += raw - (knob_filtered >> KNOBFILTER);
+    u16 filtered = knob_filtered >> KNOBFILTER;
+
+    // ADC noise stays inside the dead band, so the tempo only changes when
+    // the knob is actually turned
+    u16 moved = filtered > knob_position ? filtered - knob_position : knob_position - filtered;
+    if (moved < KNOBDEADBAND && speed) return;
+
+    knob_position = filtered;
 
     // speed = ((get_knob_value(0) * 1980) >> 16) + 40;
     // slightly more sane value for meadowphysics
-    if (delta > 0) {
-        speed = (get_knob_value(0) >> 6);
-        delta = 0;
-        knob_position = get_knob_value(0);
-        update_speed();
-    }
+    u32 sp = filtered >> 6;
+    if (sp == speed) return;
+
+    speed = sp;
+    update_speed();
 }
 
 void update_speed() {
@@ -383,110 +1024,482 @@ void update_speed() {
 
     if (sp > MAX_SPEED) sp = MAX_SPEED; else if (sp < MIN_SPEED) sp = MIN_SPEED;
 
-    half_width_pulse = (60000 / sp) / 2;
-    
-    update_timer_interval(CLOCKTIMER, 60000 / sp);
+    // the accumulated fraction is kept so a tempo change doesn't reset phase
+    clock_period = (60000UL << PERIOD_SHIFT) / sp;
+    update_gate_width();
+
+    // the tick in progress is moved to where the new tempo puts it, counted
+    // from the last tick, advance_clock() then continues with the full period
+    u16 interval = clock_period >> PERIOD_SHIFT;
+    if (interval == clock_interval) return;
+
+    u32 elapsed = get_global_time() - clock_tick_time;
+    clock_interval = interval > elapsed ? interval - elapsed : 1;
+    update_timer_interval(CLOCKTIMER, clock_interval);
+}
+
+void advance_clock() {
+    if (!clock_period) return;
+
+    // phase accumulator: each tick schedules the whole milliseconds of the
+    // period plus the fraction carried over from previous ticks, so the timer
+    // interval dithers between neighbouring values and the average is exact
+    u32 now = get_global_time();
+#ifdef PERF_STATS
+    u16 elapsed = now - clock_tick_time;
+    u16 jitter = elapsed > clock_interval ? elapsed - clock_interval : clock_interval - elapsed;
+    if (clock_tick_time && jitter > perf.clock_jitter) perf.clock_jitter = jitter;
+#endif
+    clock_tick_time = now;
+
+    clock_phase += clock_period;
+    u16 interval = clock_phase >> PERIOD_SHIFT;
+    clock_phase -= (u32)interval << PERIOD_SHIFT;
+
+    if (interval != clock_interval) {
+        clock_interval = interval;
+        update_timer_interval(CLOCKTIMER, clock_interval);
+    }
+}
+
+void external_clock() {
+    track_external_clock();
+    step();
+
+    // multiplied clock, the rest of the ticks are spread evenly over the
+    // measured period until the next edge
+    if (ext_period && p.config.clock_mult > 1) {
+        mult_remaining = p.config.clock_mult - 1;
+        add_timed_event(MULTTIMER, tick_length, 0);
+    }
+}
+
+void reset_clock() {
+    // every row back to the top in constant time, the first tick is played
+    // straight away and the internal clock counts its period from here
+    engine_set_tick(ENGINE_MASTER_PERIOD - 1);
+
+    clock_phase = 0;
+    clock_interval = clock_period >> PERIOD_SHIFT;
+    clock_tick_time = get_global_time();
+    stop_timed_event(CLOCKTIMER);
+    add_timed_event(CLOCKTIMER, clock_interval, 1);
+
+    step();
+}
+
+u8 is_midi_clocked() {
+    return last_midi_tick && get_global_time() - last_midi_tick < EXTCLOCKTIMEOUT;
+}
+
+void track_external_clock() {
+    u64 now = get_global_time();
+    u32 measured = now - last_ext_clock;
+    last_ext_clock = now;
+
+    if (measured > EXTCLOCKTIMEOUT || measured == 0) {
+        ext_period = 0;
+        update_gate_width();
+        return;
+    }
+
+    // one pole smoothing of the measured period, big tempo jumps are followed
+    // straight away instead of being slewed into
+    measured <<= PERIOD_SHIFT;
+    if (!ext_period || measured > ext_period << 1 || measured < ext_period >> 1) {
+        ext_period = measured;
+    } else {
+        ext_period += ((s32)measured - (s32)ext_period) >> 2;
+    }
+
+    update_gate_width();
+}
+
+void update_gate_width() {
+    // LONG gates are half a tick, measured from the external clock while it's
+    // being tracked and from the knob tempo otherwise
+    // an i2c leader sends every tick, only the jack clock is multiplied
+    u8 mult = p.config.clock_mult && !is_i2c_clocked() ? p.config.clock_mult : 1;
+    u32 period = ext_period ? ext_period / mult : clock_period;
+
+    half_width_pulse = period >> (PERIOD_SHIFT + 1);
+    tick_length = period >> PERIOD_SHIFT;
 }
 
 void output_clock() {
-    add_timed_event(CLOCKOUTTIMER, CLOCKOUTWIDTH, 0);
+    schedule_gate_off(CLOCK_OUT, tick_time, CLOCKOUTWIDTH);
     set_clock_output(1);
 }
 
-u8 is_circularly_referenced(u8 r) {
-    // don't allow selection of logic on selected row (self referencing)
-    return p.row[r].logic.compared_to_row > 0 && p.row[r].logic.compared_to_row - 1 == selected_row;
+void report_perf() {
+#ifdef PERF_STATS
+    u32 now = get_global_time();
+    if (now - perf.window_start < PERFWINDOW) return;
+
+    print_int("ticks", perf.step.count);
+    print_int("step min", perf.step.min);
+    print_int("step max", perf.step.max);
+    print_int("step avg", perf.step.count ? perf.step.total / perf.step.count : 0);
+    print_int("render max", perf.render.max);
+    print_int("render avg", perf.render.count ? perf.render.total / perf.render.count : 0);
+    print_int("clock jitter ms", perf.clock_jitter);
+    print_int("gate late ms", perf.gate_late);
+    print_int("led writes", perf.led_writes);
+
+    perf_shown = perf;
+    memset(&perf, 0, sizeof(perf));
+    perf.window_start = now;
+
+    if (page == DIAG) request_refresh(ALL_ROWS);
+#endif
 }
 
-void toggle_config_page() {
-    page = page == CONFIG ? MAIN : CONFIG;
+#ifdef PERF_STATS
+void add_perf_sample(perf_stat_t *stat, u32 value) {
+    if (!stat->count || value < stat->min) stat->min = value;
+    if (value > stat->max) stat->max = value;
+    stat->total += value;
+    stat->count++;
+}
+#endif
+
+void schedule_sub_ticks(u8 mask, u8 long_mask) {
+    // the engine has the schedule of every ratcheted or swung step ready in
+    // 1/256 of a tick, only scaling to the current tick length is left
+    for (u8 r = 0; r < GATE_OUTS; r++) {
+        if (!(mask & (1 << r))) continue;
+
+        engine_schedule_t *es = engine_get_schedule(row_of(r));
+        sub_tick_t *st = &sub_ticks[r];
+        u16 spacing = ((u32)tick_length * es->spacing) >> 8;
+
+        st->next = tick_time + (((u32)tick_length * es->start) >> 8);
+        st->spacing = spacing;
+        st->remaining = es->count;
+
+        // LONG steps keep a 50% width, of the ratchet spacing when ratcheted
+        if (long_mask & (1 << r)) {
+            st->width = es->count > 1 ? spacing >> 1 : half_width_pulse;
+        } else {
+            st->width = spacing >> 1 < TRIGGERWIDTH ? spacing >> 1 : TRIGGERWIDTH;
+        }
+        if (!st->width) st->width = 1;
+    }
+
+    sub_ticks_pending |= mask;
+
+    // anything due right away goes out now rather than on the next GATETIMER
+    service_gates();
 }
 
-u8 t_step(u8 r, u8 index) {
-    return p.row[r].step.pulse[index] == 1 ? 1 : 0;
+void schedule_gate_off(u8 out, u32 start, u16 width) {
+    gate_off[out] = start + width;
+    gates_pending |= 1 << out;
 }
 
-u8 t_logic(u8 r, u8 index) {
-    u8 row_div = p.row[r].division;
-    u8 target_div = p.row[r].logic.compared_to_row > 0 ? p.row[p.row[r].logic.compared_to_row - 1].division : 0;
+void service_gates() {
+    // all gate off edges and ratchet/swing triggers are serviced from
+    // GATETIMER, outputs with the same deadline switch in the same pass
+    if (!gates_pending && !sub_ticks_pending) return;
 
-    u8 len = p.row[r].logic.type > 0 ? row_div * target_div : row_div;
-    u8* row_array = malloc(len * sizeof(u8));
-    u8* target_array = malloc(len * sizeof(u8));
+    u32 now = get_global_time();
+    u16 expired = 0;
+    u8 due = 0;
 
-    u8 match;
+    for (u8 r = 0; r < GATE_OUTS; r++) {
+        sub_tick_t *st = &sub_ticks[r];
+        if (!(sub_ticks_pending & (1 << r)) || (s32)(now - st->next) < 0) continue;
 
-    for (u8 i = 0; i <= len; i++) {
-        row_array[i] = (i + 1) % row_div == 0 ? 1 : 0;
-        target_array[i] = (i + 1) % target_div == 0 ? 1 : 0;
+        due |= 1 << r;
+        schedule_gate_off(r, now, st->width);
+        st->next += st->spacing;
+        if (!--st->remaining) sub_ticks_pending &= ~(1 << r);
     }
 
-    switch (p.row[r].logic.type) {
-        case 0:
-            match = row_array[index] == 1 ? 1 : 0;
-            break;
-        case 1: // AND
-            match = row_array[index] == 1 && target_array[index] == 1 ? 1 : 0;
-            break;
-        case 2: // OR
-            match = row_array[index] == 1 || target_array[index] == 1 ? 1 : 0;
-            break;
-        case 3: // XOR
-            match = row_array[index] != target_array[index] ? 1 : 0;
-            break;
+    if (due) {
+        set_gates(due, 1);
+        for (u8 r = 0; r < GATE_OUTS; r++) {
+            if (due & (1 << r)) p.row[row_of(r)].blink = BLINKFRAMES;
+        }
+        dirty_rows |= due;
+    }
+
+    for (u8 i = 0; i <= CLOCK_OUT; i++) {
+        if (!(gates_pending & (1 << i)) || (s32)(now - gate_off[i]) < 0 || (due & (1 << i))) continue;
+
+        expired |= 1 << i;
+#ifdef PERF_STATS
+        if (now - gate_off[i] > perf.gate_late) perf.gate_late = now - gate_off[i];
+#endif
     }
 
-    free(row_array);
-    free(target_array);
+    gates_pending &= ~expired;
 
-    return match;
+    // falling edges are batched the same way as rising ones
+    set_gates(expired & 0xFF, 0);
+    if (expired & (1 << CLOCK_OUT)) set_clock_output(0);
 }
 
-void update_ticker(int r) {
-    u8 closest_row = 0;
-    u8 closest_amount = p.row[r].pattern_length;
+u8 is_circularly_referenced(u8 row, u8 r) {
+    // follow the chain of targets from r, if it leads back to row then using
+    // r as its target would close a loop
+    u8 t = r;
 
     for (u8 i = 0; i < GATE_OUTS; i++) {
-        if (p.row[r].pattern_length == p.row[i].pattern_length && r != i) {
-            tickers[r] = tickers[i];
-            return;
-        }
+        if (p.row[t].logic.compared_to_row == 0) return 0;
+        t = p.row[t].logic.compared_to_row - 1;
+        if (t == row) return 1;
     }
+
+    return 1;
+}
+
+void toggle_config_page() {
+    page = page == CONFIG || page == CHANCE ? MAIN : CONFIG;
+}
+
+u8 get_step_length(u8 r) {
+    return p.row[r].pages * STEP_PAGE;
+}
+
+void set_step_pages(u8 r, u8 pages) {
+    // steps past the new end are cleared, so what plays is what gets saved
+    step_t *st = &p.row[r].step;
+    u64 mask = pages < STEP_PAGES ? ((u64)1 << (pages * STEP_PAGE)) - 1 : ~(u64)0;
+
+    p.row[r].pages = pages;
+    st->pulse &= mask;
+    st->long_gate &= mask;
+    st->ratchet_lo &= mask;
+    st->ratchet_hi &= mask;
+}
+
+void set_page_steps(u8 r, u8 page, u16 pulse, u16 long_gate) {
+    // replaces one page of a row's steps, ratchets stay on steps still on. a
+    // step past the row's end makes it longer, clearing one never shortens it
+    step_t *st = &p.row[r].step;
+    u8 shift = page * STEP_PAGE;
+    u64 mask = (u64)0xFFFF << shift;
+
+    st->pulse = (st->pulse & ~mask) | ((u64)pulse << shift);
+    st->long_gate = (st->long_gate & ~mask) | ((u64)(long_gate & pulse) << shift);
+    st->ratchet_lo &= st->pulse;
+    st->ratchet_hi &= st->pulse;
+    if (pulse && page >= p.row[r].pages) p.row[r].pages = page + 1;
+}
+
+enum gate_lengths get_step_gate(u8 r, u8 index) {
+    if (!((p.row[r].step.pulse >> index) & 1)) return OFF;
+    return (p.row[r].step.long_gate >> index) & 1 ? LONG : SHORT;
+}
+
+void update_engine() {
+    // push the live pattern to the engine, which rebuilds its evaluation
+    // order, pattern lengths and the next tick's outputs
+    engine_set_mode(p.config.mode == LOGICAL ? ENGINE_LOGICAL : ENGINE_STEP);
+    engine_set_swing(p.config.swing);
+
     for (u8 i = 0; i < GATE_OUTS; i++) {
-        if (p.row[r].pattern_length < p.row[i].pattern_length && r != i) {
-            u8 new_offset = p.row[i].pattern_length - p.row[r].pattern_length;
-            if (new_offset < closest_amount) {
-                closest_amount = new_offset;
-                closest_row = i;
+        engine_set_row(i, p.row[i].division, p.row[i].logic.type, p.row[i].logic.compared_to_row,
+            p.row[i].step.pulse, p.row[i].step.long_gate);
+        engine_set_ratchets(i, p.row[i].step.ratchet_lo, p.row[i].step.ratchet_hi);
+        engine_set_steps(i, p.config.mode == EUCLID ? p.row[i].euclid.length : get_step_length(i));
+        engine_set_chance(i, p.row[i].chance);
+    }
+
+    engine_compile();
+}
+
+void process_i2c(u8 *data, u8 length) {
+    if (!length) return;
+
+    // a leader's ticks keep coming while nobody touches anything, only
+    // commands hold back a flash write
+    if (data[0] != I2C_TICK) last_activity = get_global_time();
+
+    u8 r = length > 1 ? data[1] : GATE_OUTS;
+
+    switch (data[0]) {
+        case I2C_SET_DIVISION:
+            if (length < 3 || r >= GATE_OUTS || data[2] < 4 || data[2] > 15) return;
+            p.row[r].position = data[2];
+            p.row[r].division = get_division(data[2]);
+            break;
+
+        case I2C_SET_LOGIC:
+            // same rules as on the grid, target 0 or NONE clears it
+            if (length < 4 || r >= GATE_OUTS || data[2] > NOR || data[3] > GATE_OUTS) return;
+            if (data[2] == NONE || data[3] == 0) {
+                p.row[r].logic.type = NONE;
+                p.row[r].logic.compared_to_row = 0;
+            } else {
+                if (data[3] - 1 == r || is_circularly_referenced(r, data[3] - 1)) return;
+                p.row[r].logic.type = data[2];
+                p.row[r].logic.compared_to_row = data[3];
             }
-        }
+            break;
+
+        case I2C_SET_STEPS:
+            if (length < 7 || r >= GATE_OUTS || data[2] >= STEP_PAGES) return;
+            set_page_steps(r, data[2], get_u16(&data[3]), get_u16(&data[5]));
+            break;
+
+        case I2C_SET_TEMPO:
+            if (length < 3) return;
+            // held to the range the knob and arc can set
+            speed = get_u16(&data[1]);
+            if (speed < MIN_SPEED) speed = MIN_SPEED;
+            if (speed > MAX_SPEED) speed = MAX_SPEED;
+            update_speed();
+            return;
+
+        case I2C_SET_DIVISIONS:
+            if (length < 1 + GATE_OUTS) return;
+            for (u8 i = 0; i < GATE_OUTS; i++) {
+                if (data[1 + i] < 4 || data[1 + i] > 15) continue;
+                p.row[i].position = data[1 + i];
+                p.row[i].division = get_division(data[1 + i]);
+            }
+            break;
+
+        case I2C_SET_ALL_STEPS:
+            if (length < 2 + 2 * GATE_OUTS || r >= STEP_PAGES) return;
+            for (u8 i = 0; i < GATE_OUTS; i++) {
+                set_page_steps(i, r, get_u16(&data[2 + 2 * i]), p.row[i].step.long_gate >> (r * STEP_PAGE));
+            }
+            break;
+
+        case I2C_RESET:
+            reset_clock();
+            return;
+
+        case I2C_LOAD_PRESET:
+            if (length < 2 || r >= MAX_PRESETS) return;
+            queue_preset(r);
+            return;
+
+        case I2C_TICK:
+            if (length < 6 || p.config.i2c_leader) return;
+            follow_i2c_tick(data);
+            return;
+
+        default:
+            return;
     }
-    tickers[r] = tickers[closest_row];
+
+    update_engine();
+    request_refresh(ALL_ROWS);
+}
+
+void set_i2c_role() {
+    if (p.config.i2c_leader == i2c_role) return;
+
+    i2c_role = p.config.i2c_leader;
+    if (i2c_role) set_as_i2c_leader(); else set_as_i2c_follower(I2C_ADDRESS);
+}
+
+void send_i2c_tick() {
+    // after the tick's edges are out, one message carries the tick and every
+    // output that fired. followers re-phase from the tick, so a restart or a
+    // dropped message needs nothing extra
+    if (tick_time - last_i2c_send < I2CMININTERVAL) return;
+    last_i2c_send = tick_time;
+
+    u8 d[6];
+    d[0] = I2C_TICK;
+    put_u32(&d[1], engine_get_tick());
+    d[5] = gates_high;
+    send_i2c(I2C_ADDRESS, d, 6);
+}
+
+void follow_i2c_tick(u8 *data) {
+    // play the same tick as the leader, only jumping when out of step
+    u32 tick = get_u32(&data[1]);
+    u32 last = tick ? tick - 1 : ENGINE_MASTER_PERIOD - 1;
+    if (engine_get_tick() != last) engine_set_tick(last);
+
+    last_i2c_tick = get_global_time();
+    track_external_clock();
+    step();
+}
+
+u8 is_i2c_clocked() {
+    return last_i2c_tick && get_global_time() - last_i2c_tick < EXTCLOCKTIMEOUT;
+}
+
+u16 get_u16(u8 *data) {
+    return (data[0] << 8) | data[1];
+}
+
+void put_u16(u8 *data, u16 value) {
+    data[0] = value >> 8;
+    data[1] = value;
+}
+
+u32 get_u32(u8 *data) {
+    return ((u32)get_u16(data) << 16) | get_u16(&data[2]);
+}
+
+void put_u32(u8 *data, u32 value) {
+    put_u16(data, value >> 16);
+    put_u16(&data[2], value);
 }
 
 void process_grid_press(u8 x, u8 y, u8 on) {
 
     if (page == CONFIG) {
-        // param load happening
-        if (page == CONFIG && x > 2 && x < 13 && y == 0 && !on) {
-            selected_preset = x - 3;
-            load_preset(selected_preset);
+        // param load happening, unless the release ends a save
+        if (x > 2 && x < 13 && y == 0 && !on) {
+            if (save_held != x + 1) queue_preset(selected_bank * PRESETS_PER_BANK + x - 3);
+            save_held = 0;
+        }
+
+        // bank select, slots above then load from and save to this bank
+        if (x > 2 && x < 13 && y == 1 && !on) {
+            select_bank(x - 3);
         }
 
         // setting of mode
-        if ((x > 2 && x < 7) && (y > 1 && y < 6) && p.config.mode == STEP) {
+        if ((x > 2 && x < 7) && (y > 1 && y < 6) && p.config.mode != LOGICAL) {
             if (!on) return;
             p.config.mode = LOGICAL;
             initialize_defaults(LOGICAL);
-        } else if ((x > 8 && x < 13) && (y > 1 && y < 6) && p.config.mode == LOGICAL) {
+        } else if ((x > 8 && x < 13) && (y > 1 && y < 6) && p.config.mode != STEP) {
             if (!on) return;
             p.config.mode = STEP;
             initialize_defaults(STEP);
+        } else if ((x == 14 || x == 15) && (y > 1 && y < 6) && p.config.mode != EUCLID) {
+            if (!on) return;
+            p.config.mode = EUCLID;
+            initialize_defaults(EUCLID);
         }
 
         // input config clocked or clock rotation
         if ((x == 14 || x == 15) && y == 0 && !on) p.config.input_config = ROTATE;
         if ((x == 0 || x == 1) && y == 0 && !on) p.config.input_config = CLOCK;
+        if (x == 13 && y == 0 && !on) p.config.input_config = RESET;
+
+        // i2c leader or follower
+        if ((x == 14 || x == 15) && y == 1 && !on) {
+            p.config.i2c_leader = !p.config.i2c_leader;
+            set_i2c_role();
+        }
+
+        // STEP page shown on the main page
+        if (x >= MAX_CLOCK_MULT && x < MAX_CLOCK_MULT + STEP_PAGES && y == 6 && !on) {
+            step_page = x - MAX_CLOCK_MULT;
+        }
+
+        // external clock multiplication
+        if (x < MAX_CLOCK_MULT && y == 6 && !on) {
+            p.config.clock_mult = x + 1;
+            update_gate_width();
+        }
+
+        // STEP mode swing
+        if (x > 7 && y == 6 && !on) {
+            p.config.swing = x - 8;
+        }
 
         // speed config via grid
         if (x >= 0 && x <= 15 && y == 7 && !on) {
@@ -494,12 +1507,51 @@ void process_grid_press(u8 x, u8 y, u8 on) {
             // 30-1000 is current limit
             speed = (x + 1) * SINGLE_DIVISION_SPEED;
             update_speed();
-            refresh_grid();
         }
 
-        refresh_grid();
-
+    } else if (page == CHANCE) {
+        // each row's chance of its outputs firing, 1/16 - always
+        if (on) p.row[row_of(y)].chance = x + 1;
     } else if (page == MAIN) {
+        // the arc follows the half pressed, in every mode. a LOGICAL logic
+        // key picks a target row, so it leaves the arc on the selected row
+        if (on && (y & ARC_RINGS) != arc_half && !(p.config.mode == LOGICAL && x > 0 && x < 4)) {
+            arc_half = y & ARC_RINGS;
+            arc_dirty = 1;
+        }
+
+        // grid rows are outputs, everything below works on pattern rows
+        y = row_of(y);
+
+        // step press, acts on release so a hold can edit ratchets instead
+        if (p.config.mode == STEP) {
+            if (on) {
+                step_held = 0;
+            } else if (!step_held) {
+                u64 bit = (u64)1 << (step_page * STEP_PAGE + x);
+                step_t *st = &p.row[y].step;
+                switch(get_step_gate(y, step_page * STEP_PAGE + x)) {
+                    case OFF:
+                        st->pulse |= bit;
+                        if (step_page >= p.row[y].pages) p.row[y].pages = step_page + 1;
+                        break;
+                    case SHORT: st->long_gate |= bit; break;
+                    case LONG:
+                        st->pulse &= ~bit;
+                        st->long_gate &= ~bit;
+                        st->ratchet_lo &= ~bit;
+                        st->ratchet_hi &= ~bit;
+                        break;
+                }
+            }
+            return;
+        }
+
+        if (p.config.mode == EUCLID) {
+            process_euclid_press(x, y, on);
+            return;
+        }
+
         if (!on) return;
 
         // select a row
@@ -512,9 +1564,9 @@ void process_grid_press(u8 x, u8 y, u8 on) {
             u8 was_toggled_off = p.row[selected_row].logic.type == x && p.row[selected_row].logic.compared_to_row - 1 == y;
             // LOGICAL button press rules for x 1-3 (NONE/AND/OR/XOR)
 
-            // don't allow for channel A->B & B->A (circular logic)
+            // don't allow for chains leading back to the selected row (circular logic)
             // don't allow selection of logic on selected row (self referencing)
-            if (is_circularly_referenced(y)) {
+            if (is_circularly_referenced(selected_row, y)) {
                 do_error = 1;
                 error_ref_row = y + 1;
             } else if (selected_row == y) {
@@ -524,8 +1576,6 @@ void process_grid_press(u8 x, u8 y, u8 on) {
                 p.row[selected_row].logic.type = was_toggled_off ? 0 : x;
                 p.row[selected_row].logic.compared_to_row = was_toggled_off ? 0 : y + 1;
                 p.row[selected_row].division = get_division(p.row[selected_row].position);
-                p.row[selected_row].pattern_length = was_toggled_off ? p.row[selected_row].division : p.row[selected_row].division * p.row[p.row[selected_row].logic.compared_to_row - 1].division;
-                update_ticker(selected_row);
             }
         }
 
@@ -534,40 +1584,142 @@ void process_grid_press(u8 x, u8 y, u8 on) {
             // LOGICAL button press rules for x 4-15 (divisions)
             p.row[y].position = x;
             p.row[y].division = get_division(p.row[y].position);
+        }
+    }
+}
 
-            if (p.row[y].logic.compared_to_row > 0) {
-                p.row[y].pattern_length = p.row[y].division * p.row[p.row[y].logic.compared_to_row - 1].division;
-            } else {
-                p.row[y].pattern_length = p.row[y].division;
-            }
+void process_euclid_press(u8 x, u8 y, u8 on) {
+    // tap sets the fills, tapping the same count again clears them. holding
+    // a key and tapping another on the same row rotates the pattern by their
+    // distance. a key held long and let go with no other tap sets the length,
+    // so it's only decided on release and can't clash with a rotate
+    euclid_t *eu = &p.row[y].euclid;
+
+    if (on) {
+        if (euclid_key && euclid_key_row == y) {
+            s8 shift = x - (euclid_key - 1);
+            while (shift < 0) shift += eu->length;
+            eu->rotation = (eu->rotation + shift) % eu->length;
+            step_held = 1;
+        } else {
+            euclid_key = x + 1;
+            euclid_key_row = y;
+            euclid_held = 0;
+            step_held = 0;
+        }
+    } else if (euclid_key == x + 1 && euclid_key_row == y) {
+        euclid_key = 0;
+        if (step_held) return;
+
+        if (euclid_held) {
+            eu->length = x + 1;
+            if (eu->fills > eu->length) eu->fills = eu->length;
+            eu->rotation %= eu->length;
+        } else {
+            if (x >= eu->length) return;
+            eu->fills = eu->fills == x + 1 ? 0 : x + 1;
+        }
+    } else {
+        return;
+    }
 
-            update_ticker(y);
+    generate_euclid(y);
+}
 
-            // update rows that logically reference this one
-            for (u8 i = 0; i < GATE_OUTS; i++) {
-                if (i != y && p.row[i].logic.compared_to_row - 1 == y) {
-                    p.row[i].pattern_length = p.row[y].division * p.row[i].division;
-                    update_ticker(i);
-                }
-            }
-        }
+void generate_euclid(u8 r) {
+    // bresenham's spread gives the same rhythms as bjorklund's algorithm,
+    // starting on a fill. only run on edits, the engine plays the result as
+    // a STEP row
+    euclid_t *eu = &p.row[r].euclid;
+    step_t *st = &p.row[r].step;
+    u16 pulse = 0;
 
-        // step press
-        if (p.config.mode == STEP) {
-            switch(p.row[y].step.gl[x]) {
-                case OFF: p.row[y].step.gl[x] = SHORT; p.row[y].step.pulse[x] = 1; break;
-                case SHORT: p.row[y].step.gl[x] = LONG; break;
-                case LONG: p.row[y].step.gl[x] = OFF; p.row[y].step.pulse[x] = 0; break;
-            }
-        }
+    for (u8 i = 0; i < eu->length; i++) {
+        if ((i * eu->fills) % eu->length < eu->fills) pulse |= 1 << ((i + eu->rotation) % eu->length);
     }
+
+    st->pulse = pulse;
+    st->long_gate &= pulse;
+    st->ratchet_lo &= pulse;
+    st->ratchet_hi &= pulse;
+}
+
+void process_arc(u8 enc, u8 dir) {
+    // encoders edit the rows their rings show, tempo on the CONFIG page
+    if (enc >= ARC_RINGS) return;
+    u8 r = get_arc_row(enc);
+
+    if (page == CONFIG) {
+        if (speed < MIN_SPEED) speed = MIN_SPEED;
+        if (dir && speed < MAX_SPEED) speed++;
+        if (!dir && speed > MIN_SPEED) speed--;
+        update_speed();
+        return;
+    }
+
+    if (p.config.mode == LOGICAL) {
+        if (dir && p.row[r].position < 15) p.row[r].position++;
+        if (!dir && p.row[r].position > 4) p.row[r].position--;
+        p.row[r].division = get_division(p.row[r].position);
+    } else if (p.config.mode == EUCLID) {
+        euclid_t *eu = &p.row[r].euclid;
+        eu->rotation = (eu->rotation + (dir ? 1 : eu->length - 1)) % eu->length;
+        generate_euclid(r);
+    } else {
+        // STEP rows have no division, the pattern is shifted a step instead
+        step_t *st = &p.row[r].step;
+        u8 length = get_step_length(r);
+        st->pulse = rotate_steps(st->pulse, length, dir);
+        st->long_gate = rotate_steps(st->long_gate, length, dir);
+        st->ratchet_lo = rotate_steps(st->ratchet_lo, length, dir);
+        st->ratchet_hi = rotate_steps(st->ratchet_hi, length, dir);
+    }
+
+    update_engine();
+    request_refresh(1 << output_of(r));
+}
+
+u64 rotate_steps(u64 steps, u8 length, u8 dir) {
+    // within the row's length, so it doesn't grow or shrink
+    u64 mask = length < 64 ? ((u64)1 << length) - 1 : ~(u64)0;
+    steps = dir ? (steps << 1) | (steps >> (length - 1)) : (steps >> 1) | (steps << (length - 1));
+    return steps & mask;
 }
 
 void process_grid_held(u8 x, u8 y) {
     // param save happening
     if (page == CONFIG && x > 2 && x < 13 && y == 0) {
-        selected_preset = x - 3;
+        selected_preset = selected_bank * PRESETS_PER_BANK + x - 3;
         save_preset_with_confirmation();
+        save_held = x + 1;
+    }
+
+    u8 r = row_of(y);
+
+    // a EUCLID key held long sets the row's length once it's let go
+    if (page == MAIN && p.config.mode == EUCLID && euclid_key == x + 1 && euclid_key_row == r) {
+        euclid_held = 1;
+    }
+
+    // hold a step to cycle its ratchets 1-4
+    if (page == MAIN && p.config.mode == STEP && !step_held && get_step_gate(r, step_page * STEP_PAGE + x) != OFF) {
+        u64 bit = (u64)1 << (step_page * STEP_PAGE + x);
+        step_t *st = &p.row[r].step;
+        u8 count = ((st->ratchet_lo & bit) ? 1 : 0) + ((st->ratchet_hi & bit) ? 2 : 0);
+
+        count = (count + 1) % ENGINE_MAX_RATCHETS;
+        st->ratchet_lo = count & 1 ? st->ratchet_lo | bit : st->ratchet_lo & ~bit;
+        st->ratchet_hi = count & 2 ? st->ratchet_hi | bit : st->ratchet_hi & ~bit;
+
+        step_held = 1;
+        update_engine();
+        request_refresh(1 << y);
+    } else if (page == MAIN && p.config.mode == STEP && !step_held) {
+        // hold an empty step to end the row on the page shown
+        set_step_pages(r, step_page + 1);
+        step_held = 1;
+        update_engine();
+        request_refresh(1 << y);
     }
 }
 
@@ -579,24 +1731,64 @@ void process_grid_held(u8 x, u8 y) {
 void set_preset_leds() {
     // save slots
     for (u8 x = 3; x < 13; x++) {
-        set_grid_led(x, 0, 6);
+        put_led(x, 0, 6);
     }
 
     // grid speed config leds
-    float asl = ((float)speed / MAX_SPEED) * 15;
-    u8 active_speed_led = (int)asl;
+    u8 active_speed_led = speed * 15 / MAX_SPEED;
     
     for (u8 x = 0; x < 16; x++) {
-        set_grid_led(x, 7, x == active_speed_led ? B_FULL + 4 : 6);
+        put_led(x, 7, x == active_speed_led ? B_FULL + 4 : 6);
+    }
+
+    // external clock multiplication
+    for (u8 x = 0; x < MAX_CLOCK_MULT; x++) {
+        put_led(x, 6, x + 1 == p.config.clock_mult ? B_FULL + 4 : B_DIM);
+    }
+
+    // STEP pages, pages any row plays through are lit
+    u8 pages = 1;
+    for (u8 i = 0; i < GATE_OUTS; i++) {
+        if (p.row[i].pages > pages) pages = p.row[i].pages;
+    }
+
+    for (u8 x = 0; x < STEP_PAGES; x++) {
+        put_led(MAX_CLOCK_MULT + x, 6, x == step_page ? B_FULL + 4 : (x < pages ? B_HALF : 1));
+    }
+
+    // swing
+    for (u8 x = 8; x < 16; x++) {
+        put_led(x, 6, x - 8 == p.config.swing ? B_FULL + 4 : (x - 8 < p.config.swing ? B_HALF : B_DIM));
     }
 
     // input config, 0+1 = CLOCK, 14+15 = ROTATE
-    set_grid_led(0, 0, p.config.input_config == 0 ? B_FULL + 4 : B_HALF);
-    set_grid_led(1, 0, p.config.input_config == 0 ? B_FULL + 4 : B_HALF);
-    set_grid_led(14, 0, p.config.input_config == 1 ? B_FULL + 4 : B_HALF);
-    set_grid_led(15, 0, p.config.input_config == 1 ? B_FULL + 4 : B_HALF);
+    put_led(0, 0, p.config.input_config == 0 ? B_FULL + 4 : B_HALF);
+    put_led(1, 0, p.config.input_config == 0 ? B_FULL + 4 : B_HALF);
+    put_led(14, 0, p.config.input_config == 1 ? B_FULL + 4 : B_HALF);
+    put_led(15, 0, p.config.input_config == 1 ? B_FULL + 4 : B_HALF);
+    put_led(13, 0, p.config.input_config == RESET ? B_FULL + 4 : B_DIM);
+
+    // i2c leader
+    put_led(14, 1, p.config.i2c_leader ? B_FULL + 4 : B_DIM);
+    put_led(15, 1, p.config.i2c_leader ? B_FULL + 4 : B_DIM);
+
+    // banks
+    // a bank waiting for a save to be written first is lit, but less
+    for (u8 x = 3; x < 13; x++) {
+        put_led(x, 1, x - 3 == selected_bank ? B_HALF + 2 : (x - 3 == next_bank ? B_HALF : B_DIM));
+    }
+
+    if (queued_preset / PRESETS_PER_BANK == selected_bank) {
+        put_led((queued_preset % PRESETS_PER_BANK) + 3, 0, B_FULL + 1);
+    }
 
-    set_grid_led((selected_preset % 10) + 3, 0, 14);
+    if (selected_preset / PRESETS_PER_BANK == selected_bank) {
+        put_led((selected_preset % PRESETS_PER_BANK) + 3, 0, 14);
+    }
+
+    if (error_slot) {
+        put_led(error_slot - 1, 0, do_blink_error ? 0 : B_FULL + 4);
+    }
 }
 
 u8 set_logic_led(u8 r, u8 t) {
@@ -604,7 +1796,7 @@ u8 set_logic_led(u8 r, u8 t) {
         return B_FULL + 3;
     } else {
         if (p.config.mode == LOGICAL) {
-            if (is_circularly_referenced(r) || selected_row == r) {
+            if (is_circularly_referenced(selected_row, r) || selected_row == r) {
                return B_DIM; 
             } else {
                 return B_DIM + 3;
@@ -615,108 +1807,282 @@ u8 set_logic_led(u8 r, u8 t) {
 }
 
 void set_glyph_leds(enum mode l) {
-    u8 bs;
-    u8 be;
-
-    if (l == LOGICAL) {
-        bs = 13;
-        be = 8;
-    } else if (l == STEP) {
-        be = 13;
-        bs = 8;
-    }
+    u8 bs = l == LOGICAL ? 13 : 8;
+    u8 be = l == STEP ? 13 : 8;
+    u8 bu = l == EUCLID ? 13 : 8;
 
     // LOGICAL
     // col 1
-    set_grid_led(3, 2, bs);
-    set_grid_led(3, 3, 2);
-    set_grid_led(3, 4, 2);
-    set_grid_led(3, 5, bs);
+    put_led(3, 2, bs);
+    put_led(3, 3, 2);
+    put_led(3, 4, 2);
+    put_led(3, 5, bs);
     // col 2
-    set_grid_led(4, 2, 2);
-    set_grid_led(4, 3, bs);
-    set_grid_led(4, 4, bs);
-    set_grid_led(4, 5, 2);
+    put_led(4, 2, 2);
+    put_led(4, 3, bs);
+    put_led(4, 4, bs);
+    put_led(4, 5, 2);
     // col 3
-    set_grid_led(5, 2, 2);
-    set_grid_led(5, 3, bs);
-    set_grid_led(5, 4, bs);
-    set_grid_led(5, 5, 2);
+    put_led(5, 2, 2);
+    put_led(5, 3, bs);
+    put_led(5, 4, bs);
+    put_led(5, 5, 2);
     // col 4
-    set_grid_led(6, 2, bs);
-    set_grid_led(6, 3, 2);
-    set_grid_led(6, 4, 2);
-    set_grid_led(6, 5, bs);
+    put_led(6, 2, bs);
+    put_led(6, 3, 2);
+    put_led(6, 4, 2);
+    put_led(6, 5, bs);
 
     // STEP
     // row 1
-    set_grid_led(9, 2, be);
-    set_grid_led(10, 2, 2);
-    set_grid_led(11, 2, be);
-    set_grid_led(12, 2, 2);
+    put_led(9, 2, be);
+    put_led(10, 2, 2);
+    put_led(11, 2, be);
+    put_led(12, 2, 2);
     // row 2
-    set_grid_led(9, 3, 2);
-    set_grid_led(10, 3, be);
-    set_grid_led(11, 3, 2);
-    set_grid_led(12, 3, be);
+    put_led(9, 3, 2);
+    put_led(10, 3, be);
+    put_led(11, 3, 2);
+    put_led(12, 3, be);
     // row 3
-    set_grid_led(9, 4, be);
-    set_grid_led(10, 4, 2);
-    set_grid_led(11, 4, be);
-    set_grid_led(12, 4, 2);
+    put_led(9, 4, be);
+    put_led(10, 4, 2);
+    put_led(11, 4, be);
+    put_led(12, 4, 2);
     // row 4
-    set_grid_led(9, 5, 2);
-    set_grid_led(10, 5, be);
-    set_grid_led(11, 5, 2);
-    set_grid_led(12, 5, be);
+    put_led(9, 5, 2);
+    put_led(10, 5, be);
+    put_led(11, 5, 2);
+    put_led(12, 5, be);
+
+    // EUCLID
+    put_led(14, 2, bu);
+    put_led(15, 2, 2);
+    put_led(14, 3, 2);
+    put_led(15, 3, bu);
+    put_led(14, 4, bu);
+    put_led(15, 4, 2);
+    put_led(14, 5, 2);
+    put_led(15, 5, 2);
+}
+
+void put_led(u8 x, u8 y, u8 level) {
+    frame[y][x] = level;
+}
+
+void flush_frame(u8 rows) {
+    for (u8 y = 0; y < GATE_OUTS; y++) {
+        if (!(rows & (1 << y))) continue;
+
+        for (u8 x = 0; x < 16; x++) {
+            if (frame[y][x] == shadow[y][x]) continue;
+            shadow[y][x] = frame[y][x];
+            set_grid_led(x, y, frame[y][x]);
+#ifdef PERF_STATS
+            perf.led_writes++;
+#endif
+        }
+    }
+}
+
+void invalidate_grid() {
+    // nothing is known about what the grid shows, resend everything
+    memset(shadow, 0xFF, sizeof(shadow));
+    request_refresh(ALL_ROWS);
+}
+
+void request_refresh(u8 rows) {
+    // coalesced, the grid is refreshed from RENDERTIMER at most once per
+    // FRAMETIME no matter how fast the clock or ROTATE input is
+    dirty_rows |= rows;
+    arc_dirty = 1;
+}
+
+void render_timer() {
+    if (dirty_rows) refresh_grid();
+
+    if (is_arc_connected() && (arc_dirty || is_arc_moved())) {
+        arc_dirty = 0;
+        refresh_arc();
+    }
+}
+
+u8 get_arc_position(u8 r) {
+    // LED the row's phase is at, or the playhead step in STEP mode
+    if (p.config.mode != LOGICAL) return engine_get_step(r);
+    return (u32)engine_get_position(r) * ARC_LEDS / engine_get_length(r);
+}
+
+u8 get_arc_row(u8 ring) {
+    return row_of(arc_half + ring);
+}
+
+u8 is_arc_moved() {
+    for (u8 i = 0; i < ARC_RINGS; i++) {
+        if (get_arc_position(get_arc_row(i)) != arc_shown[i]) return 1;
+    }
+
+    return 0;
 }
 
 void render_grid(void) {
     if (!is_grid_connected()) return;
 
-    if (page == CONFIG) {
-        clear_all_grid_leds();
+    PERF_START(cycles);
+    u8 rows = page != MAIN ? ALL_ROWS : dirty_rows;
+    dirty_rows = 0;
+
+    for (u8 y = 0; y < GATE_OUTS; y++) {
+        if (rows & (1 << y)) memset(frame[y], 0, sizeof(frame[y]));
+    }
+
+    if (page == DIAG) {
+#ifdef PERF_STATS
+        render_diag();
+#endif
+    } else if (page == CONFIG) {
         set_preset_leds();
         set_glyph_leds(p.config.mode);
-    } else {
-        clear_all_grid_leds();
+    } else if (page == CHANCE) {
+        for (u8 y = 0; y < GATE_OUTS; y++) {
+            u8 chance = p.row[row_of(y)].chance;
 
+            for (u8 x = 0; x < chance; x++) {
+                put_led(x, y, x + 1 == chance ? B_FULL + 4 : B_DIM);
+            }
+        }
+    } else {
         if (p.config.mode == LOGICAL) {
+            u8 error_row = output_of(error_ref_row > 0 ? error_ref_row - 1 : selected_row);
+
             for (u8 i = 0; i < GATE_OUTS; i++) {
-                set_grid_led(0, i, p.row[i].logic.compared_to_row > 0 ? B_DIM : 0);
-                set_grid_led(1, i, set_logic_led(i, 1));
-                set_grid_led(2, i, set_logic_led(i, 2));
-                set_grid_led(3, i, set_logic_led(i, 3));
-                set_grid_led(p.row[i].position, i, p.row[i].blink ? B_FULL + 3 : B_HALF);
-                p.row[i].blink = 0;
+                if (!(rows & (1 << i))) continue;
+                u8 r = row_of(i);
+
+                put_led(0, i, p.row[r].logic.compared_to_row > 0 ? B_DIM : 0);
+                put_led(1, i, set_logic_led(r, 1));
+                put_led(2, i, set_logic_led(r, 2));
+                put_led(3, i, set_logic_led(r, 3));
+                put_led(p.row[r].position, i, p.row[r].blink ? B_FULL + 3 : B_HALF);
+
+                if (p.row[r].blink) {
+                    p.row[r].blink--;
+                    dirty_rows |= 1 << i;
+                }
             }
 
-            if (do_blink_error == 1) {
-                set_grid_led(0, error_ref_row > 0 ? error_ref_row - 1 : selected_row, B_DIM);
-            } else {
-                set_grid_led(0, error_ref_row > 0 ? error_ref_row - 1 : selected_row, 14);
+            if (!error_slot && rows & (1 << error_row)) {
+                put_led(0, error_row, do_blink_error == 1 ? B_DIM : 14);
             }
         } else if (p.config.mode == STEP) {
             u8 step_br;
 
             for (u8 y = 0; y < GATE_OUTS; y++) {
-                for (u8 x = 0; x < 16; x++) {
-                    switch (p.row[y].step.gl[x]) {
-                        case OFF: step_br = 0; break;
-                        case SHORT: step_br = B_DIM; break;
-                        case LONG: step_br = B_HALF + 2; break;
-                    }
-                    if (x == step_ticker) {
-                        set_grid_led(x, y, p.row[y].step.pulse[x] ? step_br + 6 : 0);
-                    } else {
-                        set_grid_led(x, y, p.row[y].step.pulse[x] ? step_br : 0);
-                    }
+                if (!(rows & (1 << y))) continue;
+
+                // only the visible page, a row that ends before it is dimly lit
+                u8 r = row_of(y);
+                if (step_page >= p.row[r].pages) {
+                    for (u8 x = 0; x < STEP_PAGE; x++) put_led(x, y, 1);
+                    continue;
+                }
+
+                u8 shift = step_page * STEP_PAGE;
+                u16 pulse = p.row[r].step.pulse >> shift;
+                u16 long_gate = p.row[r].step.long_gate >> shift;
+                u16 ratchet_lo = p.row[r].step.ratchet_lo >> shift;
+                u16 ratchet_hi = p.row[r].step.ratchet_hi >> shift;
+                u8 playhead = engine_get_step(r) - shift;
+
+                // cleared above, so only steps that are on need writing. each
+                // extra ratchet is one level brighter
+                for (u8 x = 0; pulse; x++, pulse >>= 1, long_gate >>= 1, ratchet_lo >>= 1, ratchet_hi >>= 1) {
+                    if (!(pulse & 1)) continue;
+                    step_br = (long_gate & 1 ? B_HALF + 2 : B_DIM) + (ratchet_lo & 1) + ((ratchet_hi & 1) << 1);
+                    if (x == playhead) step_br += 6;
+                    put_led(x, y, step_br > 15 ? 15 : step_br);
+                }
+            }
+        } else if (p.config.mode == EUCLID) {
+            for (u8 y = 0; y < GATE_OUTS; y++) {
+                if (!(rows & (1 << y))) continue;
+
+                // the row's length is dimly lit behind its fills
+                u8 r = row_of(y);
+                for (u8 x = 0; x < p.row[r].euclid.length; x++) {
+                    u8 br = (p.row[r].step.pulse >> x) & 1 ? B_HALF : 1;
+                    put_led(x, y, x == engine_get_step(r) ? br + 6 : br);
                 }
             }
         }
     }
+
+    flush_frame(rows);
+    PERF_END(render, cycles);
+}
+
+#ifdef PERF_STATS
+u8 bit_length(u32 v) {
+    u8 bits = 0;
+    while (v) {
+        bits++;
+        v >>= 1;
+    }
+    return bits;
+}
+
+void render_diag() {
+    // log2 meters of the last complete window, one per row: step min/avg/max
+    // and render avg/max in cycles (2 bits per LED), clock jitter, gate
+    // lateness and LED writes (1 bit per LED)
+    u32 values[8] = {
+        perf_shown.step.min,
+        perf_shown.step.count ? perf_shown.step.total / perf_shown.step.count : 0,
+        perf_shown.step.max,
+        perf_shown.render.count ? perf_shown.render.total / perf_shown.render.count : 0,
+        perf_shown.render.max,
+        perf_shown.clock_jitter,
+        perf_shown.gate_late,
+        perf_shown.led_writes
+    };
+
+    for (u8 y = 0; y < 8; y++) {
+        u8 len = y < 5 ? (bit_length(values[y]) + 1) >> 1 : bit_length(values[y]);
+        if (len > 16) len = 16;
+
+        for (u8 x = 0; x < len; x++) {
+            put_led(x, y, y < 5 ? B_HALF + 2 * (y % 3) : B_FULL);
+        }
+    }
 }
+#endif
 
 void render_arc(void) {
-    // TODO: add arc support!
+    for (u8 i = 0; i < ARC_RINGS; i++) {
+        u8 r = get_arc_row(i);
+        u8 position = get_arc_position(r);
+        arc_shown[i] = position;
+
+        for (u8 led = 0; led < ARC_LEDS; led++) {
+            u8 level;
+
+            if (p.config.mode != LOGICAL) {
+                // the whole pattern around the ring, triggers light the first
+                // LED of their step and long gates all of it, the playhead
+                // lights its whole step
+                u16 length = engine_get_length(r);
+                u8 index = led * length / ARC_LEDS;
+                u8 gate = get_step_gate(r, index);
+                u8 lit = gate == LONG || (gate == SHORT && (led * length) % ARC_LEDS < length);
+                level = index == position ? (lit ? 15 : B_DIM) : (lit ? B_HALF : 0);
+            } else {
+                // the pattern filled up to where the row is in it
+                level = led == position ? 15 : (led < position ? B_DIM - 1 : 0);
+            }
+
+            if (level == arc_shadow[i][led]) continue;
+            arc_shadow[i][led] = level;
+            set_arc_led(i, led, level);
+        }
+    }
 }
\ No newline at end of file
@@ -18,9 +18,9 @@
 // shared types
 
 enum logical_type { NONE, AND, OR, NOR };
-enum mode { LOGICAL, STEP };
-enum input_config { CLOCK, ROTATE };
-enum page_type { MAIN, CONFIG };
+enum mode { LOGICAL, STEP, EUCLID };
+enum input_config { CLOCK, ROTATE, RESET };
+enum page_type { MAIN, CONFIG, DIAG, CHANCE };
 enum gate_lengths { OFF, SHORT, LONG};
 
 typedef struct {
@@ -28,14 +28,31 @@ typedef struct {
     u8 compared_to_row;
 } logic_t;
 
+// one bit per step, bit x is step x, column x % 16 of page x / 16. a step
+// fires when its pulse bit is set and is a LONG gate when its long_gate bit
+// is set as well. it fires 1 + ratchet_lo + 2 * ratchet_hi times within its
+// tick
 typedef struct {
-    u8 pulse[16];
-    enum gate_lengths gl[16];
+    u64 pulse;
+    u64 long_gate;
+    u64 ratchet_lo;
+    u64 ratchet_hi;
 } step_t;
 
+// fills spread as evenly as possible over length steps, rotated right by
+// rotation. generated into the row's step pulses on every edit
+typedef struct {
+    u8 fills;               // 0 - length
+    u8 length;              // 1 - 16
+    u8 rotation;            // 0 - length - 1
+} euclid_t;
+
 typedef struct {
     enum mode mode;
     enum input_config input_config;
+    u8 clock_mult;          // external clock multiplication, 1-4
+    u8 swing;               // delay of odd steps in STEP mode, 0-7
+    u8 i2c_leader;          // broadcast ticks to followers instead of following
     u8 clock_divs[12]; 
 } config_t;
 
@@ -44,9 +61,11 @@ typedef struct {
     u8 division;
     u8 blink;
     u8 blink_col;
-    u8 pattern_length;
     step_t step;
+    u8 pages;               // STEP pattern length in pages of 16 steps, 1 - 4
+    euclid_t euclid;
     logic_t logic;
+    u8 chance;              // of an output firing, in 1/16, 1 - 16
 } row_params_t;
 
 typedef struct {
@@ -55,11 +74,80 @@ typedef struct {
 typedef struct {
 } preset_meta_t;
 
+// live, unpacked state the controller edits and plays from
 typedef struct {
     config_t config;
     row_params_t row[8];
+} pattern_t;
+
+// presets are stored in flash packed, PRESETS_PER_BANK of them to one
+// multipass preset slot, only the selected bank is kept in ram. everything
+// that can be derived (divisions, pattern lengths, clock_divs) is rebuilt on
+// unpack
+#define PRESET_VERSION 1
+#define PRESET_BANKS 10
+#define PRESETS_PER_BANK 10
+
+// a packed preset is a string of bytes, 16 bit values high byte first, and
+// the presets of a bank follow each other in order:
+//   mode                mode in bits 0-1, ROTATE rotation in bits 2-4
+//   config              RESET in bit 0, ROTATE in bit 1, clock_mult - 1 in
+//                       bits 2-3, swing in bits 4-6, i2c_leader in bit 7
+//   8 rows of
+//     euclid (16 bit)   fills in bits 0-4, length - 1 in bits 5-8, rotation
+//                       in bits 9-12, STEP pages - 1 in bits 13-14
+//     position          position in the low nibble, 16 - chance in the high
+//     logic             logical_type in the high nibble, compared_to_row in
+//                       the low
+//     stored            a bit for each page with steps in the low nibble,
+//                       for each page with ratchets as well in the high one
+//   then for each row and stored page, pulse and long_gate (16 bit each),
+//   ratchet_lo and ratchet_hi after them if the page has ratchets
+// so a preset with no steps is 42 bytes, 4 pages on every row 170 and every
+// step ratcheted 298
+#define PACKED_HEADER 2
+#define PACKED_ROW 5
+#define PACKED_PAGE 4
+#define PACKED_PRESET_MIN (PACKED_HEADER + 8 * PACKED_ROW)
+#define PACKED_PRESET_MAX (PACKED_PRESET_MIN + 8 * 4 * 2 * PACKED_PAGE)
+
+// a slot of 2 KB, room for ten presets of 4 pages with some ratchets to
+// spare. a save that doesn't fit what is left of the bank is refused
+#define PRESET_BANK_SIZE 2047
+
+typedef struct {
+    u8 version;
+    u8 data[PRESET_BANK_SIZE];
 } preset_data_t;
 
+// the layout of the first release, one unpacked preset to a multipass slot
+// and no version, only read to bring its presets over
+typedef struct {
+    u8 pulse[16];
+    enum gate_lengths gl[16];
+} step_v0_t;
+
+typedef struct {
+    u8 position;
+    u8 division;
+    u8 blink;
+    u8 blink_col;
+    u8 pattern_length;
+    step_v0_t step;
+    logic_t logic;
+} row_params_v0_t;
+
+typedef struct {
+    enum mode mode;
+    enum input_config input_config;
+    u8 clock_divs[12];
+} config_v0_t;
+
+typedef struct {
+    config_v0_t config;
+    row_params_v0_t row[8];
+} preset_data_v0_t;
+
 
 // ----------------------------------------------------------------------------
 // firmware settings/variables main.c needs to know
@@ -7,3 +7,330 @@
 
 #include "engine.h"
 #include "control.h"
+
+engine_t e;
+
+static void prepare(void);
+static u8 eval_logic(engine_row_t *r, u16 index, u8 outputs);
+static u8 roll(u8 r, u32 *random);
+static u32 xorshift(u32 x);
+static void compile_order(void);
+static void compile_schedules(void);
+static u16 get_length(u8 r);
+static u16 gcd(u16 a, u16 b);
+
+
+// ----------------------------------------------------------------------------
+// setup
+
+void engine_init(void) {
+    for (u8 i = 0; i < ENGINE_ROWS; i++) {
+        e.row[i].division = 1;
+        e.row[i].type = LOGIC_NONE;
+        e.row[i].target = 0;
+        e.row[i].pulse = 0;
+        e.row[i].long_gate = 0;
+        e.row[i].ratchet_lo = 0;
+        e.row[i].ratchet_hi = 0;
+        e.row[i].sub_steps = 0;
+        e.row[i].steps = ENGINE_STEPS;
+        e.row[i].threshold = ENGINE_ALWAYS << 4;
+        e.row[i].length = 1;
+        e.row[i].ticker = 0;
+        e.order[i] = i;
+    }
+
+    e.mode = ENGINE_LOGICAL;
+    e.restart = 0;
+    e.master = 0;
+    e.swing = 0;
+    e.chancy = 0;
+    e.seed = 1;
+    compile_schedules();
+    prepare();
+}
+
+void engine_set_mode(u8 mode) {
+    if (mode == e.mode) return;
+
+    // a different kind of pattern starts from the top on the next tick
+    e.mode = mode;
+    e.restart = 1;
+}
+
+void engine_set_row(u8 row, u8 division, u8 type, u8 target, u64 pulse, u64 long_gate) {
+    engine_row_t *r = &e.row[row];
+
+    r->division = division ? division : 1;
+    r->type = target > 0 && target <= ENGINE_ROWS ? type : LOGIC_NONE;
+    r->target = r->type == LOGIC_NONE ? 0 : target;
+    r->pulse = pulse;
+    r->long_gate = long_gate;
+}
+
+void engine_set_ratchets(u8 row, u64 lo, u64 hi) {
+    e.row[row].ratchet_lo = lo;
+    e.row[row].ratchet_hi = hi;
+}
+
+void engine_set_steps(u8 row, u8 steps) {
+    e.row[row].steps = steps && steps <= ENGINE_STEPS ? steps : ENGINE_STEPS;
+}
+
+void engine_set_chance(u8 row, u8 chance) {
+    // chance in 1/16, the threshold is worked out here so the tick path only
+    // compares
+    if (chance > ENGINE_ALWAYS) chance = ENGINE_ALWAYS;
+    e.row[row].threshold = chance << 4;
+
+    if (chance < ENGINE_ALWAYS) e.chancy |= 1 << row; else e.chancy &= ~(1 << row);
+}
+
+void engine_set_seed(u32 seed) {
+    // chance decisions follow from the seed and the tick only, so a pattern
+    // plays the same each time through
+    e.seed = seed;
+}
+
+void engine_set_swing(u8 swing) {
+    e.swing = swing > ENGINE_MAX_SWING ? ENGINE_MAX_SWING : swing;
+}
+
+void engine_compile(void) {
+    // call after changing rows, rebuilds evaluation order, pattern lengths and
+    // ratchet/swing schedules and evaluates the next tick again
+    compile_order();
+    compile_schedules();
+
+    // the next tick is the top of every pattern
+    if (e.restart) {
+        e.master = ENGINE_MASTER_PERIOD - 1;
+        e.restart = 0;
+    }
+
+    // pattern lengths build on their targets', so go in evaluation order. the
+    // position is rebuilt from the master tick, constant time and always in
+    // phase with every other row
+    for (u8 i = 0; i < ENGINE_ROWS; i++) {
+        u8 r = e.order[i];
+        e.row[r].length = get_length(r);
+        e.row[r].ticker = e.master % e.row[r].length;
+    }
+
+    prepare();
+}
+
+void engine_set_tick(u32 tick) {
+    // jump to another master tick, used to follow an outside timing source.
+    // lengths don't change, so this is just rebuilding positions
+    e.master = tick % ENGINE_MASTER_PERIOD;
+
+    for (u8 i = 0; i < ENGINE_ROWS; i++) {
+        e.row[i].ticker = e.master % e.row[i].length;
+    }
+
+    prepare();
+}
+
+
+// ----------------------------------------------------------------------------
+// tick path
+
+void engine_tick(void) {
+    // rows advance by one alongside the master tick rather than dividing it
+    // each time, both wrap on multiples of the row length
+    if (++e.master >= ENGINE_MASTER_PERIOD) e.master = 0;
+
+    for (u8 i = 0; i < ENGINE_ROWS; i++) {
+        engine_row_t *r = &e.row[i];
+        if (++r->ticker >= r->length) r->ticker = 0;
+    }
+
+    prepare();
+}
+
+u8 engine_get_outputs(void) {
+    return e.ready;
+}
+
+u8 engine_get_long_gates(void) {
+    return e.ready_long;
+}
+
+u8 engine_get_sub_ticks(void) {
+    return e.ready_sub;
+}
+
+engine_schedule_t *engine_get_schedule(u8 row) {
+    // schedule of the step row fires on the next tick, if it's in
+    // engine_get_sub_ticks()
+    return &e.schedule[e.sub_schedule[row]];
+}
+
+
+// ----------------------------------------------------------------------------
+// state
+
+u8 engine_get_step(u8 row) {
+    // the step the next tick plays
+    engine_row_t *r = &e.row[row];
+    return r->ticker + 1 < r->length ? r->ticker + 1 : 0;
+}
+
+u32 engine_get_tick(void) {
+    return e.master;
+}
+
+u16 engine_get_position(u8 row) {
+    return e.row[row].ticker;
+}
+
+u16 engine_get_length(u8 row) {
+    return e.row[row].length;
+}
+
+
+// ----------------------------------------------------------------------------
+// helpers
+
+void prepare() {
+    // outputs for the next tick, evaluated ahead so a clock edge only has to
+    // drive them
+    u8 outputs = 0, long_gates = 0, sub = 0;
+
+    // a random byte per row, only drawn when a row needs one
+    u32 random[2] = {0, 0};
+    if (e.chancy) {
+        u32 next = e.master + 1 < ENGINE_MASTER_PERIOD ? e.master + 1 : 0;
+        random[0] = xorshift(e.seed ^ (next * 2654435761UL));
+        random[1] = xorshift(random[0]);
+    }
+
+    if (e.mode == ENGINE_LOGICAL) {
+        // single pass in compiled order, chained logic sees the next tick's
+        // outputs of its targets
+        for (u8 i = 0; i < ENGINE_ROWS; i++) {
+            u8 r = e.order[i];
+            engine_row_t *row = &e.row[r];
+            u16 index = row->ticker + 1 < row->length ? row->ticker + 1 : 0;
+
+            if (eval_logic(row, index, outputs) && roll(r, random)) outputs |= 1 << r;
+        }
+    } else {
+        for (u8 i = 0; i < ENGINE_ROWS; i++) {
+            engine_row_t *row = &e.row[i];
+            u8 index = row->ticker + 1 < row->length ? row->ticker + 1 : 0;
+            u64 bit = (u64)1 << index;
+
+            if (!(row->pulse & bit) || !roll(i, random)) continue;
+            if (row->long_gate & bit) long_gates |= 1 << i;
+
+            // ratcheted and swung steps only need their schedule looked up,
+            // everything else fires on the edge
+            if (row->sub_steps & bit) {
+                sub |= 1 << i;
+                e.sub_schedule[i] = (index & 1) * ENGINE_MAX_RATCHETS
+                    + ((row->ratchet_lo & bit) ? 1 : 0) + ((row->ratchet_hi & bit) ? 2 : 0);
+            } else {
+                outputs |= 1 << i;
+            }
+        }
+    }
+
+    e.ready = outputs;
+    e.ready_long = long_gates;
+    e.ready_sub = sub;
+}
+
+u8 eval_logic(engine_row_t *r, u16 index, u8 outputs) {
+    // closed form: a division fires on the last tick of its period, the target
+    // is the output of its row on the same tick, already evaluated
+    u8 row_gate = (index + 1) % r->division == 0 ? 1 : 0;
+    u8 target_gate = r->target && (outputs & (1 << (r->target - 1))) ? 1 : 0;
+
+    switch (r->type) {
+        case LOGIC_AND:
+            return row_gate && target_gate;
+        case LOGIC_OR:
+            return row_gate || target_gate;
+        case LOGIC_XOR:
+            return row_gate != target_gate;
+        default:
+            return row_gate;
+    }
+}
+
+u8 roll(u8 r, u32 *random) {
+    if (!(e.chancy & (1 << r))) return 1;
+    return ((random[r >> 2] >> ((r & 3) << 3)) & 0xFF) < e.row[r].threshold;
+}
+
+u32 xorshift(u32 x) {
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return x;
+}
+
+void compile_order() {
+    u8 depth[ENGINE_ROWS];
+
+    for (u8 r = 0; r < ENGINE_ROWS; r++) {
+        // length of the chain of targets below this row, capped in case a
+        // loop slipped in (it then just sees last evaluated state)
+        u8 d = 0;
+        for (u8 t = r; d < ENGINE_ROWS && e.row[t].target; d++) {
+            t = e.row[t].target - 1;
+        }
+        depth[r] = d;
+    }
+
+    u8 k = 0;
+    for (u8 d = 0; d <= ENGINE_ROWS; d++) {
+        for (u8 r = 0; r < ENGINE_ROWS; r++) {
+            if (depth[r] == d) e.order[k++] = r;
+        }
+    }
+}
+
+void compile_schedules() {
+    // one schedule per ratchet count for even and for odd (swung) steps, rows
+    // just flag which of their steps need one
+    for (u8 odd = 0; odd < 2; odd++) {
+        u16 start = odd ? e.swing << 4 : 0;
+
+        for (u8 c = 0; c < ENGINE_MAX_RATCHETS; c++) {
+            engine_schedule_t *s = &e.schedule[odd * ENGINE_MAX_RATCHETS + c];
+            s->start = start;
+            s->count = c + 1;
+            s->spacing = (256 - start) / s->count;
+        }
+    }
+
+    for (u8 i = 0; i < ENGINE_ROWS; i++) {
+        engine_row_t *row = &e.row[i];
+        row->sub_steps = row->pulse & (row->ratchet_lo | row->ratchet_hi | (e.swing ? 0xAAAAAAAAAAAAAAAAULL : 0));
+    }
+}
+
+u16 get_length(u8 r) {
+    if (e.mode == ENGINE_STEP) return e.row[r].steps;
+
+    // a logic pattern repeats once the row's division and its target's pattern
+    // line up again, which is their least common multiple rather than the
+    // product. targets' lengths must be up to date
+    u16 division = e.row[r].division;
+    if (!e.row[r].target) return division;
+
+    u16 target_length = e.row[e.row[r].target - 1].length;
+    return division / gcd(division, target_length) * target_length;
+}
+
+u16 gcd(u16 a, u16 b) {
+    while (b) {
+        u16 t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
@@ -3,3 +3,81 @@
 // ----------------------------------------------------------------------------
 
 #pragma once
+#include "types.h"
+
+#define ENGINE_ROWS 8
+#define ENGINE_STEPS 64
+#define ENGINE_MAX_RATCHETS 4
+#define ENGINE_MAX_SWING 7
+#define ENGINE_ALWAYS 16
+
+// every pattern length divides this (lcm of all divisions, of step lengths
+// 1 - 16 and of whole pages of 16 steps), so a master counter wrapping at it
+// keeps all rows phase locked forever
+#define ENGINE_MASTER_PERIOD 5765760UL
+
+enum engine_mode { ENGINE_LOGICAL, ENGINE_STEP };
+enum engine_logic { LOGIC_NONE, LOGIC_AND, LOGIC_OR, LOGIC_XOR };
+
+typedef struct {
+    u8 division;            // logical clock division
+    u8 type;                // engine_logic, how the target is combined
+    u8 target;              // row + 1 combined with, 0 for none
+    u64 pulse;              // step mode, bit x fires on step x
+    u64 long_gate;          // step mode, bit x makes step x a long gate
+    u64 ratchet_lo;         // step mode, step x fires 1 + lo + 2 * hi times
+    u64 ratchet_hi;
+    u64 sub_steps;          // steps that fire through a schedule, built on compile
+    u8 steps;               // step mode pattern length, 1 - ENGINE_STEPS
+    u16 threshold;          // fires when a random byte is below it, 256 always does
+    u16 length;             // pattern length in ticks
+    u16 ticker;             // position within the pattern
+} engine_row_t;
+
+// when the triggers of a step land within its tick, in 1/256 of a tick
+typedef struct {
+    u16 start;
+    u16 spacing;
+    u8 count;
+} engine_schedule_t;
+
+typedef struct {
+    engine_row_t row[ENGINE_ROWS];
+    u8 order[ENGINE_ROWS];  // evaluation order, logic targets first
+    u8 mode;
+    u8 restart;             // start all rows from the top on the next compile
+    u32 master;             // last tick, every row's position is master % length
+    u8 ready;               // outputs the next tick fires
+    u8 ready_long;          // which of them are long gates
+    u8 ready_sub;           // outputs the next tick fires through a schedule instead
+    u8 sub_schedule[ENGINE_ROWS];
+    u8 swing;               // delay of odd steps, 0 - ENGINE_MAX_SWING
+    u8 chancy;              // rows that don't always fire
+    u32 seed;
+    engine_schedule_t schedule[2 * ENGINE_MAX_RATCHETS];
+} engine_t;
+
+// setup
+void engine_init(void);
+void engine_set_mode(u8 mode);
+void engine_set_row(u8 row, u8 division, u8 type, u8 target, u64 pulse, u64 long_gate);
+void engine_set_ratchets(u8 row, u64 lo, u64 hi);
+void engine_set_steps(u8 row, u8 steps);
+void engine_set_chance(u8 row, u8 chance);
+void engine_set_seed(u32 seed);
+void engine_set_swing(u8 swing);
+void engine_compile(void);
+void engine_set_tick(u32 tick);
+
+// tick path
+void engine_tick(void);
+u8 engine_get_outputs(void);
+u8 engine_get_long_gates(void);
+u8 engine_get_sub_ticks(void);
+engine_schedule_t *engine_get_schedule(u8 row);
+
+// state
+u8 engine_get_step(u8 row);
+u32 engine_get_tick(void);
+u16 engine_get_position(u8 row);
+u16 engine_get_length(u8 row);
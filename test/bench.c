@@ -0,0 +1,172 @@
+// ----------------------------------------------------------------------------
+// host benchmark, plays synthetic clock, grid and timer events through
+// process_event() and reports ticks per second, step() time and grid LED
+// writes per tick for each mode, then the cost of engine_tick(), which is
+// mostly prepare(), on its own
+// ----------------------------------------------------------------------------
+
+#include <stdio.h>
+
+#include "interface.h"
+#include "engine.h"
+#include "host.h"
+
+#define TICKS 20000
+#define TICK_MS 2
+#define EDIT_EVERY 64
+#define ENGINE_TICKS 1000000
+
+typedef struct {
+    const char *name;
+    void (*setup)(void);
+    void (*edit)(u32 tick);
+} scenario_t;
+
+static void setup_logical(void);
+static void setup_step(void);
+static void setup_euclid(void);
+static void edit_logical(u32 tick);
+static void edit_steps(u32 tick);
+static void select_mode(u8 x);
+static void run(scenario_t *sc);
+static void run_engine(const char *name, u8 mode, u8 chance);
+
+int main(void) {
+    scenario_t scenarios[] = {
+        { "logical", setup_logical, edit_logical },
+        { "step", setup_step, edit_steps },
+        { "euclid", setup_euclid, edit_steps },
+    };
+
+    for (u8 i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+        run(&scenarios[i]);
+    }
+
+    run_engine("logical", ENGINE_LOGICAL, ENGINE_ALWAYS);
+    run_engine("logical chance", ENGINE_LOGICAL, 8);
+    run_engine("step", ENGINE_STEP, ENGINE_ALWAYS);
+    run_engine("step chance", ENGINE_STEP, 8);
+
+    return 0;
+}
+
+void run(scenario_t *sc) {
+    host_init();
+    sc->setup();
+    host_run(100);
+
+    u32 ticks = host_ticks, leds = host_led_writes;
+    host_renders = host_render_worst = 0;
+    host_render_total = 0;
+
+    u32 step_worst = 0;
+    u64 step_total = 0;
+    u64 start = host_ns();
+
+    for (u32 t = 0; t < TICKS; t++) {
+        u64 edge = host_ns();
+        host_clock_edge();
+        u32 elapsed = host_ns() - edge;
+
+        step_total += elapsed;
+        if (elapsed > step_worst) step_worst = elapsed;
+
+        if (t % EDIT_EVERY == 0) sc->edit(t);
+        host_run(TICK_MS);
+    }
+
+    double seconds = (host_ns() - start) / 1e9;
+    ticks = host_ticks - ticks;
+    leds = host_led_writes - leds;
+
+    printf("%-8s %6u ticks %9.0f ticks/s  step avg %5.0f ns worst %6u ns  render avg %5.0f ns worst %6u ns  %5.2f led writes/tick\n",
+        sc->name, ticks, ticks / seconds, (double)step_total / TICKS, step_worst,
+        host_renders ? (double)host_render_total / host_renders : 0, host_render_worst,
+        ticks ? (double)leds / ticks : 0);
+}
+
+void run_engine(const char *name, u8 mode, u8 chance) {
+    // every row busy: logic chained through all 8 rows, or full 64 step
+    // pages with ratchets and swing
+    engine_init();
+    engine_set_mode(mode);
+    engine_set_swing(mode == ENGINE_STEP ? 3 : 0);
+
+    for (u8 r = 0; r < ENGINE_ROWS; r++) {
+        engine_set_row(r, r + 1, r ? 1 + r % 3 : 0, r, 0x5555555555555555ULL << (r & 1), 0x0F0F0F0F0F0F0F0FULL);
+        engine_set_ratchets(r, 0x1111111111111111ULL, 0x0101010101010101ULL);
+        engine_set_steps(r, ENGINE_STEPS);
+        engine_set_chance(r, chance);
+    }
+    engine_compile();
+
+    // outputs are folded in so the loop can't be dropped
+    u8 fired = 0;
+    u64 start = host_ns();
+    for (u32 t = 0; t < ENGINE_TICKS; t++) {
+        engine_tick();
+        fired ^= engine_get_outputs() | engine_get_sub_ticks();
+    }
+    double ns = (double)(host_ns() - start) / ENGINE_TICKS;
+
+    printf("engine_tick %-15s %6.1f ns/tick  %02x\n", name, ns, fired);
+}
+
+void select_mode(u8 x) {
+    // through the CONFIG page like on the module
+    host_front();
+    host_tap(x, 2);
+    host_front();
+}
+
+void setup_logical(void) {
+    // a chain of logic, row 1 AND row 0, row 2 OR row 1, row 3 XOR row 2
+    for (u8 y = 1; y < 4; y++) {
+        host_tap(0, y);
+        host_tap(y, y - 1);
+    }
+}
+
+void setup_step(void) {
+    // all 4 pages full of steps, every other one long, ratchets on the first
+    // page and some swing
+    select_mode(9);
+
+    for (u8 page = 0; page < 4; page++) {
+        for (u8 y = 0; y < 8; y++) {
+            u16 pulses = 0x5555 << (y & 1) | 0x0101;
+            u8 d[7] = { 0x03, y, page, pulses >> 8, pulses, 0xF0, 0xF0 };
+            host_i2c(d, 7);
+        }
+    }
+
+    for (u8 y = 0; y < 8; y++) {
+        host_press(8, y, 1);
+        host_hold(8, y);
+        host_press(8, y, 0);
+    }
+
+    host_front();
+    host_tap(11, 6);
+    host_front();
+}
+
+void setup_euclid(void) {
+    select_mode(14);
+
+    for (u8 y = 0; y < 8; y++) {
+        host_tap(y + 2, y);
+    }
+}
+
+void edit_logical(u32 tick) {
+    // move a division
+    u8 y = (tick / EDIT_EVERY) % 8;
+    host_tap(4 + (tick / EDIT_EVERY) % 12, y);
+}
+
+void edit_steps(u32 tick) {
+    // toggle a step, or change EUCLID fills
+    u8 y = (tick / EDIT_EVERY) % 8;
+    host_tap((tick / EDIT_EVERY) % 16, y);
+}
@@ -0,0 +1,20 @@
+// ----------------------------------------------------------------------------
+// minimal checks for the host tests, a failed check is printed and counted
+// and the test goes on
+// ----------------------------------------------------------------------------
+
+#pragma once
+#include <stdio.h>
+
+extern int check_failures;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        check_failures++; \
+        printf("%s:%d: ", __FILE__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+    } \
+} while (0)
+
+#define CHECK_DONE(name) (printf("%s: %s\n", name, check_failures ? "FAILED" : "ok"), check_failures ? 1 : 0)
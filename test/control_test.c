@@ -0,0 +1,586 @@
+// ----------------------------------------------------------------------------
+// controller checks through process_event(), the way multipass drives it
+//
+// ticks come from an i2c leader so every test knows which master tick it's
+// playing, and outputs are read back from what went to the gates
+// ----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <string.h>
+
+#include "interface.h"
+#include "engine.h"
+#include "host.h"
+#include "check.h"
+
+// leader ticks further apart than a trigger, so every one is a new edge
+#define TICK_MS 15
+
+int check_failures;
+
+extern pattern_t p;
+extern preset_data_t bank;
+extern u8 selected_bank;
+extern u32 speed;
+
+static void test_logic_rotation(void);
+static void test_midi_clock(void);
+static void test_i2c_tempo(void);
+static void test_step_pages(void);
+static void test_euclid_lengths(void);
+static void test_euclid_gesture(void);
+static void test_preset_queue(void);
+static void test_save_idle(void);
+static void test_save_keeps_edits(void);
+static void test_bank_switch_waits(void);
+static void test_bank_full(void);
+static void test_arc_half(void);
+static void test_migrate_baseline(void);
+static u8 play_tick(u32 tick);
+static void select_mode(u8 x);
+static void set_input(u8 x);
+static void set_euclid(u8 y, u8 length, u8 fills);
+static void long_press(u8 x, u8 y);
+static u8 *get_packed(preset_data_t *b, u8 preset);
+static u16 get_packed_size(u8 *d);
+static u64 get_packed_steps(u8 *d, u8 r, u8 mask);
+
+int main(void) {
+    test_logic_rotation();
+    test_midi_clock();
+    test_i2c_tempo();
+    test_step_pages();
+    test_euclid_lengths();
+    test_euclid_gesture();
+    test_preset_queue();
+    test_save_idle();
+    test_save_keeps_edits();
+    test_bank_switch_waits();
+    test_bank_full();
+    test_arc_half();
+    test_migrate_baseline();
+
+    return CHECK_DONE("control_test");
+}
+
+
+// ----------------------------------------------------------------------------
+// tests
+
+void test_logic_rotation(void) {
+    // default divisions are 1 - 8 for rows 0 - 7, row 3 is then XORed with
+    // row 5. ROTATE moves each row to the next output down, logic included
+    host_init();
+    u8 logic[4] = { 0x02, 3, NOR, 6 };
+    host_i2c(logic, 4);
+
+    set_input(14);
+
+    for (u8 rotation = 0; rotation < 10; rotation++) {
+        for (u32 t = 0; t < 2 * 840; t++) {
+            u8 fired = play_tick(t), expected = 0;
+
+            for (u8 o = 0; o < 8; o++) {
+                u8 r = (o + rotation) % 8;
+                u8 own = (t + 1) % (r + 1) == 0;
+                if (r == 3) own = own != ((t + 1) % 6 == 0);
+                if (own) expected |= 1 << o;
+            }
+
+            CHECK(fired == expected, "rotation %u tick %u: fired %02x, expected %02x", rotation, t, fired, expected);
+            if (fired != expected) return;
+        }
+
+        host_clock_edge();
+    }
+}
+
+void test_midi_clock(void) {
+    // note 60 on channel 16 clocks while the jack is empty, nothing else does
+    host_init();
+    host_ext_clock = 0;
+
+    u32 ticks = host_ticks;
+    host_midi_note(15, 61, 100);
+    host_midi_note(0, 60, 100);
+    host_midi_note(15, 60, 0);
+    CHECK(host_ticks == ticks, "%u ticks from other notes", host_ticks - ticks);
+
+    host_midi_note(15, 60, 100);
+    CHECK(host_ticks == ticks + 1, "%u ticks from one clock note", host_ticks - ticks);
+
+    // and holds off the internal clock while the notes keep coming
+    ticks = host_ticks;
+    for (u8 i = 0; i < 20; i++) {
+        host_run(100);
+        host_midi_note(15, 60, 100);
+    }
+    CHECK(host_ticks == ticks + 20, "%u ticks from 20 clock notes", host_ticks - ticks);
+
+    host_ext_clock = 1;
+}
+
+void test_i2c_tempo(void) {
+    // an i2c tempo outside MIN_SPEED - MAX_SPEED is held to the range
+    host_init();
+    u8 d[3] = { 0x04, 0, 0 };
+    host_i2c(d, 3);
+    CHECK(speed == 30, "tempo 0 set speed %u", speed);
+
+    d[1] = 0xFF;
+    d[2] = 0xFF;
+    host_i2c(d, 3);
+    CHECK(speed == 1000, "tempo 65535 set speed %u", speed);
+
+    d[1] = 0;
+    d[2] = 120;
+    host_i2c(d, 3);
+    CHECK(speed == 120, "tempo 120 set speed %u", speed);
+}
+
+void test_step_pages(void) {
+    // a step past a STEP row's end makes it longer, clearing it doesn't make
+    // it shorter again, holding an empty step ends the row on the page shown
+    host_init();
+    select_mode(9);
+
+    static const struct {
+        u8 page, set, length, fires;
+    } cases[] = {
+        { 1, 1, 32, 21 },       // a step on page 1
+        { 3, 1, 64, 21 },       // and on page 3, 64 steps
+        { 3, 0, 64, 21 },       // page 3 cleared, still 64 steps ending in rests
+        { 1, 0, 64, 64 },       // every page empty, nothing fires
+    };
+
+    for (u8 i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        u8 d[7] = { 0x03, 3, cases[i].page, 0x00, cases[i].set ? 0x20 : 0, 0, 0 };
+        host_i2c(d, 7);
+
+        u8 length = cases[i].length;
+        CHECK(p.row[3].pages * 16 == length, "case %u: %u pages", i, p.row[3].pages);
+        for (u32 t = 0; t < 3 * length; t++) {
+            u8 fired = play_tick(t), expected = t % length == cases[i].fires ? 1 << 3 : 0;
+            if (cases[i].page == 3 && cases[i].set && t % length == 53) expected = 1 << 3;
+            CHECK(fired == expected, "case %u tick %u: fired %02x, expected %02x", i, t, fired, expected);
+            if (fired != expected) return;
+        }
+    }
+
+    // a step on page 2, then held empty on page 1 the row is 32 steps and
+    // the step past its end is gone
+    u8 d[7] = { 0x03, 3, 2, 0x00, 0x20, 0, 0 };
+    host_i2c(d, 7);
+    d[2] = 0;
+    host_i2c(d, 7);
+
+    host_front();
+    host_tap(5, 6);
+    host_front();
+    long_press(0, 3);
+    CHECK(p.row[3].pages == 2 && p.row[3].step.pulse == 1 << 5, "held empty step left %u pages, steps %llx",
+        p.row[3].pages, (unsigned long long)p.row[3].step.pulse);
+
+    for (u32 t = 0; t < 3 * 32; t++) {
+        u8 fired = play_tick(t), expected = t % 32 == 5 ? 1 << 3 : 0;
+        CHECK(fired == expected, "two pages tick %u: fired %02x, expected %02x", t, fired, expected);
+        if (fired != expected) return;
+    }
+
+    // and a tap on page 3 makes it 64 steps again
+    host_front();
+    host_tap(7, 6);
+    host_front();
+    host_tap(0, 3);
+    CHECK(p.row[3].pages == 4 && p.row[3].step.pulse == ((u64)1 << 48 | 1 << 5), "tap on page 3 left %u pages, steps %llx",
+        p.row[3].pages, (unsigned long long)p.row[3].step.pulse);
+}
+
+void test_euclid_lengths(void) {
+    // every length and fill count, spread evenly from a fill on step 0, and
+    // rotated without changing its length
+    host_init();
+    select_mode(14);
+
+    for (u8 length = 1; length <= 16; length++) {
+        for (u8 fills = 0; fills <= length; fills++) {
+            u8 y = (length + fills) % 8, pattern[16];
+            set_euclid(y, length, fills);
+
+            u8 count = 0, last = 0, gap_min = 255, gap_max = 0;
+            for (u32 t = 0; t < 2 * length; t++) {
+                u8 fired = (play_tick(t) >> y) & 1;
+                if (t < length) {
+                    pattern[t] = fired;
+                } else {
+                    CHECK(fired == pattern[t - length], "length %u fills %u tick %u differs from the first time through",
+                        length, fills, t);
+                }
+                if (!fired) continue;
+
+                // gaps between fills, the next time through the first one too
+                if (count) {
+                    u8 gap = t - last;
+                    if (gap < gap_min) gap_min = gap;
+                    if (gap > gap_max) gap_max = gap;
+                }
+                last = t;
+                if (t < length) count++;
+            }
+
+            CHECK(count == fills, "length %u fills %u fired %u times", length, fills, count);
+            CHECK(!fills || pattern[0], "length %u fills %u doesn't start on a fill", length, fills);
+            CHECK(fills < 2 || gap_max - gap_min < 2, "length %u fills %u gaps %u - %u", length, fills, gap_min, gap_max);
+
+            // rotate by 3 with a held key and a tap to its right
+            if (length < 4) continue;
+            host_press(0, y, 1);
+            host_tap(3, y);
+            host_press(0, y, 0);
+            CHECK(p.row[y].euclid.length == length && p.row[y].euclid.rotation == 3,
+                "length %u fills %u rotated to length %u rotation %u", length, fills, p.row[y].euclid.length, p.row[y].euclid.rotation);
+
+            for (u32 t = 0; t < length; t++) {
+                u8 fired = (play_tick(t) >> y) & 1;
+                CHECK(fired == pattern[(t + length - 3) % length], "length %u fills %u rotated 3 tick %u: %u",
+                    length, fills, t, fired);
+            }
+
+            // and back for the next one
+            host_press(3, y, 1);
+            host_tap(0, y);
+            host_press(3, y, 0);
+            CHECK(p.row[y].euclid.rotation == 0, "length %u fills %u rotated back to %u", length, fills, p.row[y].euclid.rotation);
+        }
+    }
+}
+
+void test_euclid_gesture(void) {
+    // a key held long enough to count as held still rotates when another is
+    // tapped, and only sets the length when let go on its own
+    host_init();
+    select_mode(14);
+    set_euclid(2, 8, 3);
+
+    host_press(2, 2, 1);
+    host_hold(2, 2);
+    host_tap(5, 2);
+    host_press(2, 2, 0);
+    CHECK(p.row[2].euclid.length == 8 && p.row[2].euclid.fills == 3 && p.row[2].euclid.rotation == 3,
+        "held rotate left length %u fills %u rotation %u", p.row[2].euclid.length, p.row[2].euclid.fills, p.row[2].euclid.rotation);
+
+    // a hold on another row doesn't set this row's length
+    host_press(6, 2, 1);
+    host_hold(6, 4);
+    host_press(6, 2, 0);
+    CHECK(p.row[2].euclid.length == 8 && p.row[2].euclid.fills == 7 && p.row[4].euclid.length == 16,
+        "hold on row 4 left row 2 length %u fills %u, row 4 length %u",
+        p.row[2].euclid.length, p.row[2].euclid.fills, p.row[4].euclid.length);
+
+    long_press(4, 2);
+    CHECK(p.row[2].euclid.length == 5 && p.row[2].euclid.fills == 5 && p.row[2].euclid.rotation == 3,
+        "held key set length %u fills %u rotation %u", p.row[2].euclid.length, p.row[2].euclid.fills, p.row[2].euclid.rotation);
+}
+
+void test_preset_queue(void) {
+    // a preset from another bank queued over i2c starts on the next bar
+    // a bank of empty presets is all zeroes, preset 7 of it is made a STEP
+    // preset with row 1 firing on the first step, the presets after it still
+    // read as zeroes once its row 1 page is in
+    host_init();
+    memset(&host_flash[5], 0, sizeof(host_flash[5]));
+    host_flash[5].version = PRESET_VERSION;
+    u8 *pp = host_flash[5].data + 7 * PACKED_PRESET_MIN;
+    pp[0] = STEP;
+    pp[PACKED_HEADER + PACKED_ROW + 4] = 1;
+    pp[PACKED_PRESET_MIN + 1] = 1;
+
+    for (u32 t = 0; t < 4; t++) play_tick(t);
+    u8 load[2] = { 0x07, 57 };
+    host_i2c(load, 2);
+
+    for (u32 t = 4; t < 48; t++) {
+        u8 fired = (play_tick(t) >> 1) & 1;
+        u8 expected = t < 16 ? t % 2 == 1 : t % 16 == 0;
+        CHECK(fired == expected, "tick %u: row 1 fired %u, expected %u", t, fired, expected);
+    }
+    CHECK(p.config.mode == STEP, "queued preset didn't load, mode %u", p.config.mode);
+
+    // the bank it came from is the one in ram now, and nothing was written
+    u64 pulse = get_packed_steps(get_packed(&bank, 7), 1, 0);
+    CHECK(pulse == 1 && host_flash_writes == 0, "bank in ram %llx, %u flash writes", (unsigned long long)pulse, host_flash_writes);
+}
+
+void test_save_idle(void) {
+    // a saved preset waits until grid, front button and i2c commands have
+    // been idle for a while, a leader's ticks don't count
+    host_init();
+    select_mode(9);
+    host_tap(4, 0);
+    host_front();
+    long_press(5, 0);
+    host_front();
+
+    for (u8 i = 0; i < 30; i++) {
+        host_run(200);
+        host_tap(7, 7);
+    }
+    CHECK(host_flash_writes == 0, "%u flash writes while busy", host_flash_writes);
+
+    for (u32 t = 0; t < 200; t++) play_tick(t);
+    CHECK(host_flash_writes == 2, "%u flash writes once idle, expected the bank and the index", host_flash_writes);
+    CHECK(host_flash_index == 2, "preset index %u in flash", host_flash_index);
+
+    // what was saved is there after a power cycle
+    host_boot();
+    CHECK(p.config.mode == STEP && p.row[0].step.pulse == 1 << 4 && !p.row[7].step.pulse,
+        "after boot mode %u row 0 %llx row 7 %llx", p.config.mode,
+        (unsigned long long)p.row[0].step.pulse, (unsigned long long)p.row[7].step.pulse);
+}
+
+void test_save_keeps_edits(void) {
+    // letting go of the slot a hold saved to doesn't queue it, so the saved
+    // snapshot doesn't replace edits made after it on the next bar
+    host_init();
+    select_mode(9);
+    host_front();
+    long_press(8, 0);
+    host_front();
+    host_tap(2, 0);
+
+    u8 count = 0;
+    for (u32 t = 0; t < 48; t++) {
+        if (play_tick(t) & 1) count++;
+    }
+    CHECK(count == 3 && p.row[0].step.pulse == 1 << 2, "edit after saving fired %u times, row 0 %llx",
+        count, (unsigned long long)p.row[0].step.pulse);
+}
+
+void test_bank_switch_waits(void) {
+    // with a save pending neither a bank tap nor a preset queued from another
+    // bank writes flash from the event, both wait for the save to be written
+    host_init();
+    select_mode(9);
+    host_tap(4, 0);
+    host_front();
+    long_press(5, 0);
+    host_tap(8, 1);
+    host_front();
+
+    u8 load[2] = { 0x07, 57 };
+    host_i2c(load, 2);
+    CHECK(host_flash_writes == 0 && selected_bank == 0, "%u flash writes, bank %u", host_flash_writes, selected_bank);
+
+    u8 busy = 0;
+    for (u32 t = 0; t < 200; t++) {
+        play_tick(t);
+        if (!host_flash_writes && p.config.mode != STEP) busy = 1;
+    }
+    CHECK(!busy, "preset 57 loaded before the save was written");
+    u64 pulse = get_packed_steps(get_packed(&host_flash[0], 2), 0, 0);
+    CHECK(host_flash_writes == 2 && pulse == 1 << 4, "%u flash writes, slot 2 row 0 %llx", host_flash_writes, (unsigned long long)pulse);
+    CHECK(selected_bank == 5 && p.config.mode == LOGICAL, "after the write bank %u mode %u", selected_bank, p.config.mode);
+}
+
+void test_bank_full(void) {
+    // 4 pages on every row with a ratchet on each, 298 bytes a preset, six
+    // of them fit in a bank and the seventh save is refused
+    host_init();
+    select_mode(9);
+
+    for (u8 page = 0; page < 4; page++) {
+        u8 d[18] = { 0x06, page };
+        memset(&d[2], 0xFF, 16);
+        host_i2c(d, 18);
+
+        host_front();
+        host_tap(4 + page, 6);
+        host_front();
+        for (u8 y = 0; y < 8; y++) long_press(0, y);
+    }
+
+    host_front();
+    for (u8 slot = 0; slot < 7; slot++) long_press(3 + slot, 0);
+    host_front();
+
+    u16 sizes[PRESETS_PER_BANK];
+    for (u8 i = 0; i < PRESETS_PER_BANK; i++) sizes[i] = get_packed_size(get_packed(&bank, i));
+    CHECK(sizes[0] == PACKED_PRESET_MAX && sizes[5] == PACKED_PRESET_MAX && sizes[6] == PACKED_PRESET_MIN,
+        "preset sizes %u %u %u", sizes[0], sizes[5], sizes[6]);
+    CHECK(get_packed_steps(get_packed(&bank, 5), 7, 2) == 0x0001000100010001ULL,
+        "slot 5 row 7 ratchets %llx", (unsigned long long)get_packed_steps(get_packed(&bank, 5), 7, 2));
+
+    // what did fit is written, and reads back the same
+    for (u32 t = 0; t < 200; t++) play_tick(t);
+    CHECK(!memcmp(&host_flash[0], &bank, sizeof(bank)), "bank 0 in flash differs from ram");
+
+    u8 load[2] = { 0x07, 5 };
+    host_i2c(load, 2);
+    host_i2c(load, 2);
+    CHECK(p.row[3].pages == 4 && p.row[3].step.pulse == ~0ULL && p.row[3].step.ratchet_lo == 0x0001000100010001ULL,
+        "slot 5 loaded %u pages, steps %llx", p.row[3].pages, (unsigned long long)p.row[3].step.pulse);
+}
+
+void test_arc_half(void) {
+    // the rings follow the half of the grid pressed last in every mode,
+    // except for LOGICAL logic keys which pick a target row
+    host_init();
+    select_mode(9);
+    host_tap(0, 5);
+    host_arc_turn(1, 1);
+    CHECK(p.row[5].step.pulse == 1 << 1, "STEP ring 1 left row 5 at %llx", (unsigned long long)p.row[5].step.pulse);
+
+    select_mode(14);
+    host_tap(3, 2);
+    host_arc_turn(2, 1);
+    CHECK(p.row[2].euclid.rotation == 1, "EUCLID ring 2 left row 2 rotation %u", p.row[2].euclid.rotation);
+
+    select_mode(3);
+    host_tap(0, 6);
+    host_tap(1, 1);
+    host_arc_turn(2, 0);
+    CHECK(p.row[6].logic.type == AND && p.row[6].position == 8, "LOGICAL ring 2 left row 6 logic %u position %u",
+        p.row[6].logic.type, p.row[6].position);
+}
+
+void test_migrate_baseline(void) {
+    // the 10 presets of the first release, unpacked one to a slot, come back
+    // as bank 0 and every other bank starts over
+    static preset_data_v0_t old[PRESETS_PER_BANK];
+
+    host_init();
+    memset(old, 0, sizeof(old));
+    for (u8 i = 0; i < PRESETS_PER_BANK; i++) {
+        preset_data_v0_t *op = &old[i];
+        op->config.mode = i & 1 ? STEP : LOGICAL;
+        op->config.input_config = i & 2 ? ROTATE : CLOCK;
+        memcpy(op->config.clock_divs, (u8[]) { 128, 64, 32, 16, 8, 7, 6, 5, 4, 3, 2, 1 }, 12);
+
+        for (u8 r = 0; r < 8; r++) {
+            op->row[r].position = 4 + (i + r) % 12;
+            op->row[r].logic.type = r ? (i + r) % 4 : NONE;
+            op->row[r].logic.compared_to_row = op->row[r].logic.type ? r : 0;
+            for (u8 x = 0; x < 16; x++) {
+                if ((x + i + r) % 3) continue;
+                op->row[r].step.pulse[x] = 1;
+                op->row[r].step.gl[x] = x & 1 ? LONG : SHORT;
+            }
+        }
+    }
+
+    memset(host_flash, 0xEE, sizeof(host_flash));
+    memcpy(host_flash, old, sizeof(old));
+    host_flash_index = 7;
+    host_boot();
+
+    u32 bad = 0;
+    for (u8 b = 0; b < PRESET_BANKS; b++) {
+        CHECK(host_flash[b].version == PRESET_VERSION, "bank %u version %u", b, host_flash[b].version);
+    }
+
+    for (u8 i = 0; i < PRESETS_PER_BANK; i++) {
+        u8 *pp = get_packed(&host_flash[0], i);
+        if (pp[0] != (i & 1) || pp[1] != (i & 2)) bad++;
+
+        for (u8 r = 0; r < 8; r++) {
+            u64 pulse = 0, long_gate = 0;
+            for (u8 x = 0; x < 16; x++) {
+                if ((x + i + r) % 3) continue;
+                pulse |= 1 << x;
+                if (x & 1) long_gate |= 1 << x;
+            }
+
+            u8 *pr = pp + PACKED_HEADER + r * PACKED_ROW;
+            u8 logic = old[i].row[r].logic.type << 4 | old[i].row[r].logic.compared_to_row;
+            if (get_packed_steps(pp, r, 0) != pulse || get_packed_steps(pp, r, 1) != long_gate || get_packed_steps(pp, r, 2)
+                || pr[0] >> 5 != 0 || pr[2] != old[i].row[r].position || pr[3] != logic) bad++;
+        }
+    }
+    CHECK(!bad, "%u presets or rows differ after migrating the first release", bad);
+
+    // the rest are defaults, and preset 7 plays from where it was
+    CHECK(!memcmp(&host_flash[1], &host_flash[PRESET_BANKS - 1], sizeof(host_flash[1]))
+        && get_packed(&host_flash[1], PRESETS_PER_BANK) - host_flash[1].data == PRESETS_PER_BANK * PACKED_PRESET_MIN,
+        "banks 1 - 9 aren't all defaults");
+    CHECK(p.config.mode == STEP && p.config.input_config == ROTATE && p.row[2].position == 4 + 9 % 12,
+        "preset 7 plays mode %u input %u row 2 position %u", p.config.mode, p.config.input_config, p.row[2].position);
+
+    // and a second start leaves it as it is
+    preset_data_t first = host_flash[0];
+    host_boot();
+    CHECK(!memcmp(&first, &host_flash[0], sizeof(first)) && host_flash_writes == 0, "second start wrote %u times", host_flash_writes);
+}
+
+// ----------------------------------------------------------------------------
+// helpers
+
+u8 play_tick(u32 tick) {
+    // one tick from a leader, returns the outputs that fired on it
+    u8 d[6] = { 0x20, tick >> 24, tick >> 16, tick >> 8, tick, 0 };
+
+    host_fired = 0;
+    host_i2c(d, 6);
+    host_run(TICK_MS);
+    return host_fired;
+}
+
+void select_mode(u8 x) {
+    host_front();
+    host_tap(x, 2);
+    host_front();
+}
+
+void set_input(u8 x) {
+    host_front();
+    host_tap(x, 0);
+    host_front();
+}
+
+void set_euclid(u8 y, u8 length, u8 fills) {
+    // length first, it clamps the fills
+    long_press(length - 1, y);
+
+    u8 current = p.row[y].euclid.fills;
+    if (fills != current) host_tap((fills ? fills : current) - 1, y);
+}
+
+void long_press(u8 x, u8 y) {
+    host_press(x, y, 1);
+    host_hold(x, y);
+    host_press(x, y, 0);
+}
+
+u8 *get_packed(preset_data_t *b, u8 preset) {
+    // walked the way control.h lays a bank out, presets one after another
+    u8 *d = b->data;
+    while (preset--) d += get_packed_size(d);
+    return d;
+}
+
+u16 get_packed_size(u8 *d) {
+    u16 size = PACKED_PRESET_MIN;
+    for (u8 r = 0; r < 8; r++) size += PACKED_PAGE * __builtin_popcount(d[PACKED_HEADER + r * PACKED_ROW + 4]);
+    return size;
+}
+
+u64 get_packed_steps(u8 *d, u8 r, u8 mask) {
+    // mask 0 - 3 as pulse, long_gate, ratchet_lo, ratchet_hi
+    u8 *at = d + PACKED_PRESET_MIN;
+    u64 steps = 0;
+
+    for (u8 i = 0; i <= r; i++) {
+        u8 stored = d[PACKED_HEADER + i * PACKED_ROW + 4];
+
+        for (u8 page = 0; page < 4; page++) {
+            if (!((stored >> page) & 1)) continue;
+            u8 ratchets = (stored >> (4 + page)) & 1;
+
+            if (i == r && (mask < 2 || ratchets)) {
+                u8 *v = at + 2 * mask;
+                steps |= (u64)(v[0] << 8 | v[1]) << (page * 16);
+            }
+            at += ratchets ? 2 * PACKED_PAGE : PACKED_PAGE;
+        }
+    }
+    return steps;
+}
@@ -0,0 +1,363 @@
+// ----------------------------------------------------------------------------
+// engine checks against a reference model
+//
+// the reference works out every output from its definition for any tick,
+// with no state carried between ticks, and the engine's precomputed outputs
+// have to match it on every tick
+// ----------------------------------------------------------------------------
+
+#include <stdio.h>
+
+#include "engine.h"
+#include "check.h"
+
+#define LOGIC_TICKS 1500
+#define WRAP_LEAD 700
+#define RANDOM_CHAINS 3000
+#define RANDOM_TICKS 2000
+#define CHANCE_TICKS 65536
+
+typedef struct {
+    u8 division;
+    u8 type;
+    u8 target;              // row + 1, 0 for none
+} ref_row_t;
+
+int check_failures;
+
+static const u8 divisions[] = { 128, 64, 32, 16, 8, 7, 6, 5, 4, 3, 2, 1 };
+static const u8 step_lengths[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 32, 48, 64 };
+
+#define DIVISIONS (sizeof(divisions) / sizeof(divisions[0]))
+#define STEP_LENGTHS (sizeof(step_lengths) / sizeof(step_lengths[0]))
+
+static ref_row_t ref[ENGINE_ROWS];
+static u32 rng = 2463534242UL;
+
+static void test_logic_chains(void);
+static void test_random_chains(void);
+static void test_logic_lengths(void);
+static void test_step_lengths(void);
+static void test_chance(void);
+static void load_ref(void);
+static u8 run_ref(u32 start, u32 ticks);
+static u8 ref_gate(u8 r, u32 tick);
+static u8 ref_outputs(u32 tick);
+static u16 ref_length(u8 r);
+static u32 next_tick(void);
+static u32 next_random(void);
+static u64 random_mask(void);
+
+int main(void) {
+    test_logic_chains();
+    test_random_chains();
+    test_logic_lengths();
+    test_step_lengths();
+    test_chance();
+
+    return CHECK_DONE("engine_test");
+}
+
+
+// ----------------------------------------------------------------------------
+// tests
+
+void test_logic_chains(void) {
+    // every division of row 0 and 1 and 2, with every logic type of row 1 on
+    // row 0 and of row 2 on row 1, so each type also sees a chained target.
+    // each one runs across the master wrap
+    for (u8 a = 0; a < DIVISIONS; a++) {
+        for (u8 b = 0; b < DIVISIONS; b++) {
+            for (u8 c = 0; c < DIVISIONS; c++) {
+                for (u8 t = 0; t < 16; t++) {
+                    for (u8 r = 0; r < ENGINE_ROWS; r++) ref[r] = (ref_row_t) { 1, LOGIC_NONE, 0 };
+                    ref[0] = (ref_row_t) { divisions[a], LOGIC_NONE, 0 };
+                    ref[1] = (ref_row_t) { divisions[b], t & 3, 1 };
+                    ref[2] = (ref_row_t) { divisions[c], t >> 2, 2 };
+
+                    load_ref();
+                    if (!run_ref(ENGINE_MASTER_PERIOD - WRAP_LEAD, LOGIC_TICKS)) return;
+                }
+            }
+        }
+    }
+}
+
+void test_random_chains(void) {
+    // all 8 rows, targets anywhere as long as there's no loop, so rows are
+    // often evaluated in a different order than their number
+    for (u32 i = 0; i < RANDOM_CHAINS; i++) {
+        u8 rank[ENGINE_ROWS];
+        for (u8 r = 0; r < ENGINE_ROWS; r++) rank[r] = r;
+        for (u8 r = ENGINE_ROWS - 1; r > 0; r--) {
+            u8 j = next_random() % (r + 1), t = rank[r];
+            rank[r] = rank[j];
+            rank[j] = t;
+        }
+
+        // a row can only target a row ranked below it
+        for (u8 r = 0; r < ENGINE_ROWS; r++) {
+            ref[rank[r]].division = divisions[next_random() % DIVISIONS];
+            ref[rank[r]].type = r ? next_random() % 4 : LOGIC_NONE;
+            ref[rank[r]].target = ref[rank[r]].type ? rank[next_random() % r] + 1 : 0;
+        }
+
+        load_ref();
+        if (!run_ref(next_random() % ENGINE_MASTER_PERIOD, RANDOM_TICKS)) return;
+    }
+}
+
+void test_logic_lengths(void) {
+    // a chained pattern repeats on the lcm of the chain, and every pattern
+    // has to divide the master period or rows drift apart on the wrap
+    for (u32 i = 0; i < RANDOM_CHAINS; i++) {
+        for (u8 r = 0; r < ENGINE_ROWS; r++) {
+            ref[r].division = divisions[next_random() % DIVISIONS];
+            ref[r].type = r ? 1 + next_random() % 3 : LOGIC_NONE;
+            ref[r].target = r ? r : 0;
+        }
+
+        load_ref();
+        for (u8 r = 0; r < ENGINE_ROWS; r++) {
+            u16 length = engine_get_length(r);
+            CHECK(length == ref_length(r), "row %u length %u, expected %u", r, length, ref_length(r));
+            CHECK(ENGINE_MASTER_PERIOD % length == 0, "row %u length %u doesn't divide the master period", r, length);
+        }
+    }
+}
+
+void test_step_lengths(void) {
+    // every length control can set, EUCLID's 1 - 16 and STEP's whole pages,
+    // each row a different one, with random steps, long gates and ratchets,
+    // without and with swing
+    for (u8 swing = 0; swing <= ENGINE_MAX_SWING; swing += ENGINE_MAX_SWING) {
+        for (u8 l = 0; l < STEP_LENGTHS; l++) {
+            u64 pulse[ENGINE_ROWS], long_gate[ENGINE_ROWS], lo[ENGINE_ROWS], hi[ENGINE_ROWS];
+            u8 steps[ENGINE_ROWS];
+
+            engine_init();
+            engine_set_mode(ENGINE_STEP);
+            engine_set_swing(swing);
+
+            for (u8 r = 0; r < ENGINE_ROWS; r++) {
+                steps[r] = step_lengths[(l + r) % STEP_LENGTHS];
+                pulse[r] = random_mask();
+                long_gate[r] = random_mask() & pulse[r];
+                lo[r] = random_mask() & random_mask();
+                hi[r] = random_mask() & random_mask();
+
+                engine_set_row(r, 1, LOGIC_NONE, 0, pulse[r], long_gate[r]);
+                engine_set_ratchets(r, lo[r], hi[r]);
+                engine_set_steps(r, steps[r]);
+            }
+            engine_set_tick(l * ENGINE_STEPS);
+            engine_compile();
+
+            // a change of mode starts every row from the top
+            CHECK(next_tick() == 0, "steps %u: first tick after the mode change is %u", step_lengths[l], next_tick());
+
+            for (u32 i = 0; i < 3 * ENGINE_STEPS; i++) {
+                u32 n = next_tick();
+                u8 fired = 0, held = 0, sub = 0;
+
+                for (u8 r = 0; r < ENGINE_ROWS; r++) {
+                    u8 index = n % steps[r];
+                    u64 bit = (u64)1 << index;
+                    if (!(pulse[r] & bit)) continue;
+
+                    fired |= 1 << r;
+                    if (long_gate[r] & bit) held |= 1 << r;
+                    if (((lo[r] | hi[r]) & bit) || (swing && (index & 1))) sub |= 1 << r;
+                }
+
+                u8 outputs = engine_get_outputs(), subs = engine_get_sub_ticks();
+                CHECK((outputs | subs) == fired && subs == sub && engine_get_long_gates() == held,
+                    "steps %u swing %u tick %u: outputs %02x sub %02x long %02x, expected %02x %02x %02x",
+                    step_lengths[l], swing, n, outputs, subs, engine_get_long_gates(), fired & ~sub, sub, held);
+                if ((outputs | subs) != fired || subs != sub) return;
+
+                // ratchets and swing of the steps that go through a schedule
+                for (u8 r = 0; r < ENGINE_ROWS; r++) {
+                    if (!(subs & (1 << r))) continue;
+
+                    u8 index = n % steps[r];
+                    u64 bit = (u64)1 << index;
+                    u8 count = 1 + ((lo[r] & bit) ? 1 : 0) + ((hi[r] & bit) ? 2 : 0);
+                    u16 start = index & 1 ? swing << 4 : 0;
+                    engine_schedule_t *s = engine_get_schedule(r);
+
+                    CHECK(s->count == count && s->start == start && s->start + (count - 1) * s->spacing < 256,
+                        "steps %u swing %u tick %u row %u: %u triggers from %u every %u, expected %u from %u",
+                        step_lengths[l], swing, n, r, s->count, s->start, s->spacing, count, start);
+                }
+
+                engine_tick();
+            }
+        }
+    }
+}
+
+void test_chance(void) {
+    // each row fires every tick, so the rate is the chance. row 7 always
+    // fires, and rows 0 and 4 are drawn from different words
+    engine_init();
+    engine_set_seed(1234);
+    for (u8 r = 0; r < ENGINE_ROWS; r++) engine_set_chance(r, r < 7 ? 2 * r + 2 : ENGINE_ALWAYS);
+    engine_compile();
+    engine_set_tick(ENGINE_MASTER_PERIOD - 1);
+
+    u32 count[ENGINE_ROWS] = {0}, both = 0;
+    u8 played[RANDOM_TICKS];
+
+    for (u32 i = 0; i < CHANCE_TICKS; i++) {
+        u8 outputs = engine_get_outputs();
+        if (i < RANDOM_TICKS) played[i] = outputs;
+
+        for (u8 r = 0; r < ENGINE_ROWS; r++) {
+            if (outputs & (1 << r)) count[r]++;
+        }
+        if ((outputs & 0x11) == 0x11) both++;
+
+        engine_tick();
+    }
+
+    for (u8 r = 0; r < ENGINE_ROWS; r++) {
+        u32 chance = r < 7 ? 2 * r + 2 : ENGINE_ALWAYS;
+        u32 expected = CHANCE_TICKS / ENGINE_ALWAYS * chance;
+        u32 off = count[r] > expected ? count[r] - expected : expected - count[r];
+        CHECK(off < CHANCE_TICKS / 64, "row %u chance %u fired %u of %u, expected about %u", r, chance, count[r], CHANCE_TICKS, expected);
+    }
+
+    // rows 0 (2/16) and 4 (10/16) shouldn't be any more likely to fire together
+    u32 expected = (u64)count[0] * count[4] / CHANCE_TICKS;
+    u32 off = both > expected ? both - expected : expected - both;
+    CHECK(off < CHANCE_TICKS / 128, "rows 0 and 4 fired together %u times, expected about %u", both, expected);
+
+    // the same seed and tick decide the same way, however the tick is reached
+    engine_set_tick(ENGINE_MASTER_PERIOD - 1);
+    for (u32 i = 0; i < RANDOM_TICKS; i++) {
+        CHECK(engine_get_outputs() == played[i], "tick %u played %02x again, %02x the first time", i, engine_get_outputs(), played[i]);
+        if (engine_get_outputs() != played[i]) break;
+        engine_tick();
+    }
+
+    engine_set_tick(RANDOM_TICKS / 2 - 1);
+    CHECK(engine_get_outputs() == played[RANDOM_TICKS / 2], "jumping to tick %u played %02x, %02x ticking there",
+        RANDOM_TICKS / 2, engine_get_outputs(), played[RANDOM_TICKS / 2]);
+
+    // and another seed plays something else
+    u32 same = 0;
+    engine_set_seed(4321);
+    engine_set_tick(ENGINE_MASTER_PERIOD - 1);
+    for (u32 i = 0; i < RANDOM_TICKS; i++) {
+        if (engine_get_outputs() == played[i]) same++;
+        engine_tick();
+    }
+    CHECK(same < RANDOM_TICKS / 2, "seed 4321 played %u of %u ticks like seed 1234", same, RANDOM_TICKS);
+
+    // chained logic sees its target after chance, row 1 OR row 0 fires
+    // whenever row 0 did or its own division does
+    engine_init();
+    engine_set_row(0, 1, LOGIC_NONE, 0, 0, 0);
+    engine_set_row(1, 128, LOGIC_OR, 1, 0, 0);
+    engine_set_chance(0, 8);
+    engine_compile();
+
+    for (u32 i = 0; i < CHANCE_TICKS; i++) {
+        u32 n = next_tick();
+        u8 outputs = engine_get_outputs();
+        u8 expected = (outputs & 1) || (n + 1) % 128 == 0;
+        CHECK(((outputs >> 1) & 1) == expected, "tick %u: row 0 %u, row 1 OR row 0 %u", n, outputs & 1, (outputs >> 1) & 1);
+        if (((outputs >> 1) & 1) != expected) break;
+        engine_tick();
+    }
+}
+
+
+// ----------------------------------------------------------------------------
+// reference model
+
+void load_ref(void) {
+    engine_init();
+    engine_set_mode(ENGINE_LOGICAL);
+
+    for (u8 r = 0; r < ENGINE_ROWS; r++) {
+        engine_set_row(r, ref[r].division, ref[r].type, ref[r].target, 0, 0);
+    }
+
+    engine_compile();
+}
+
+u8 run_ref(u32 start, u32 ticks) {
+    // compares the outputs prepared for each of ticks ticks from start, stops
+    // at the first difference
+    engine_set_tick(start);
+
+    for (u32 i = 0; i < ticks; i++) {
+        u32 n = next_tick();
+        u8 outputs = engine_get_outputs(), expected = ref_outputs(n);
+
+        if (outputs != expected) {
+            CHECK(0, "tick %u: outputs %02x, expected %02x", n, outputs, expected);
+            for (u8 r = 0; r < ENGINE_ROWS; r++) {
+                printf("  row %u division %u type %u target %u\n", r, ref[r].division, ref[r].type, ref[r].target);
+            }
+            return 0;
+        }
+
+        engine_tick();
+    }
+
+    return 1;
+}
+
+u8 ref_gate(u8 r, u32 tick) {
+    // a division fires on the last tick of every period of its own, counted
+    // from the top of the master period
+    u8 own = (tick + 1) % ref[r].division == 0;
+    if (ref[r].type == LOGIC_NONE || !ref[r].target) return own;
+
+    u8 target = ref_gate(ref[r].target - 1, tick);
+    switch (ref[r].type) {
+        case LOGIC_AND: return own && target;
+        case LOGIC_OR: return own || target;
+        default: return own != target;
+    }
+}
+
+u8 ref_outputs(u32 tick) {
+    u8 outputs = 0;
+    for (u8 r = 0; r < ENGINE_ROWS; r++) {
+        if (ref_gate(r, tick)) outputs |= 1 << r;
+    }
+    return outputs;
+}
+
+u16 ref_length(u8 r) {
+    u32 length = ref[r].division;
+    if (!ref[r].target) return length;
+
+    u32 target = ref_length(ref[r].target - 1), a = length, b = target;
+    while (b) {
+        u32 t = a % b;
+        a = b;
+        b = t;
+    }
+    return length / a * target;
+}
+
+u32 next_tick(void) {
+    u32 tick = engine_get_tick() + 1;
+    return tick < ENGINE_MASTER_PERIOD ? tick : 0;
+}
+
+u32 next_random(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+u64 random_mask(void) {
+    return (u64)next_random() << 32 | next_random();
+}
@@ -0,0 +1,255 @@
+// ----------------------------------------------------------------------------
+// host side stand-in for multipass main.c and the module hardware
+// ----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "interface.h"
+#include "host.h"
+
+typedef struct {
+    u64 next;
+    u16 interval;
+    u8 repeat;
+    u8 active;
+} host_timer_t;
+
+u64 host_time;
+u8 host_ext_clock = 1;
+u8 host_arc;
+u16 host_knob = 120 << 6;
+
+u8 host_gates;
+u8 host_fired;
+u32 host_ticks;
+u32 host_led_writes;
+u32 host_flash_writes;
+
+u32 host_renders;
+u32 host_render_worst;
+u64 host_render_total;
+
+preset_data_t host_flash[PRESET_BANKS];
+u8 host_flash_index;
+
+static host_timer_t timers[HOST_TIMERS];
+static u8 grid_requested, arc_requested;
+
+static void render(void);
+
+
+// ----------------------------------------------------------------------------
+// driving control.c
+
+void host_init(void) {
+    // like a freshly flashed module, init_presets() and then init_control()
+    memset(host_flash, 0, sizeof(host_flash));
+    host_flash_index = 0;
+    init_presets();
+    host_boot();
+}
+
+void host_boot(void) {
+    // power up with whatever is in host_flash
+    memset(timers, 0, sizeof(timers));
+    host_time = 1;
+    host_gates = host_fired = 0;
+    host_ticks = host_led_writes = host_flash_writes = 0;
+    host_renders = host_render_worst = 0;
+    host_render_total = 0;
+
+    init_control();
+}
+
+void host_run(u32 ms) {
+    for (u32 i = 0; i < ms; i++) {
+        host_time++;
+
+        for (u8 t = 0; t < HOST_TIMERS; t++) {
+            if (!timers[t].active || timers[t].next > host_time) continue;
+
+            if (timers[t].repeat) timers[t].next += timers[t].interval; else timers[t].active = 0;
+            u8 data[1] = { t };
+            process_event(TIMED_EVENT, data, 1);
+        }
+
+        render();
+    }
+}
+
+void host_clock_edge(void) {
+    u8 data[2] = { 0, 1 };
+    process_event(MAIN_CLOCK_RECEIVED, data, 2);
+}
+
+void host_press(u8 x, u8 y, u8 on) {
+    u8 data[3] = { x, y, on };
+    process_event(GRID_KEY_PRESSED, data, 3);
+}
+
+void host_tap(u8 x, u8 y) {
+    host_press(x, y, 1);
+    host_press(x, y, 0);
+}
+
+void host_hold(u8 x, u8 y) {
+    u8 data[2] = { x, y };
+    process_event(GRID_KEY_HELD, data, 2);
+}
+
+void host_front(void) {
+    u8 data[1] = { 0 };
+    process_event(FRONT_BUTTON_PRESSED, data, 1);
+}
+
+void host_arc_turn(u8 enc, u8 dir) {
+    u8 data[2] = { enc, dir };
+    process_event(ARC_ENCODER_COARSE, data, 2);
+}
+
+void host_i2c(u8 *data, u8 length) {
+    process_event(I2C_RECEIVED, data, length);
+}
+
+void host_midi_note(u8 channel, u8 note, u8 velocity) {
+    u8 data[3] = { channel, note, velocity };
+    process_event(MIDI_NOTE, data, 3);
+}
+
+u64 host_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+u32 host_cycles(void) {
+    return host_ns();
+}
+
+void render(void) {
+    // multipass renders from its main loop once a refresh was asked for
+    if (grid_requested) {
+        grid_requested = 0;
+
+        u64 start = host_ns();
+        render_grid();
+        u32 elapsed = host_ns() - start;
+
+        host_renders++;
+        host_render_total += elapsed;
+        if (elapsed > host_render_worst) host_render_worst = elapsed;
+    }
+
+    if (arc_requested) {
+        arc_requested = 0;
+        render_arc();
+    }
+}
+
+
+// ----------------------------------------------------------------------------
+// interface.h
+
+void add_timed_event(u8 index, u16 interval, u8 repeat) {
+    if (index >= HOST_TIMERS) return;
+    timers[index].interval = interval ? interval : 1;
+    timers[index].next = host_time + timers[index].interval;
+    timers[index].repeat = repeat;
+    timers[index].active = 1;
+}
+
+void stop_timed_event(u8 index) {
+    if (index < HOST_TIMERS) timers[index].active = 0;
+}
+
+void update_timer_interval(u8 index, u16 interval) {
+    // counts the new interval from now
+    if (index >= HOST_TIMERS) return;
+    timers[index].interval = interval ? interval : 1;
+    timers[index].next = host_time + timers[index].interval;
+}
+
+u64 get_global_time(void) {
+    return host_time;
+}
+
+void set_gate(u8 index, u8 on) {
+    if (on && !(host_gates & (1 << index))) host_fired |= 1 << index;
+    host_gates = on ? host_gates | (1 << index) : host_gates & ~(1 << index);
+}
+
+void set_clock_output(u8 on) {
+    if (on) host_ticks++;
+}
+
+u8 is_external_clock_connected(void) {
+    return host_ext_clock;
+}
+
+u8 get_knob_count(void) {
+    return 1;
+}
+
+u16 get_knob_value(u8 index) {
+    return host_knob;
+}
+
+u8 is_grid_connected(void) {
+    return 1;
+}
+
+void set_grid_led(u8 x, u8 y, u8 level) {
+    host_led_writes++;
+}
+
+void refresh_grid(void) {
+    grid_requested = 1;
+}
+
+u8 is_arc_connected(void) {
+    return host_arc;
+}
+
+void set_arc_led(u8 enc, u8 led, u8 level) {
+}
+
+void refresh_arc(void) {
+    arc_requested = 1;
+}
+
+void store_shared_data_to_flash(shared_data_t *shared) {
+}
+
+void store_preset_to_flash(u8 index, preset_meta_t *meta, preset_data_t *preset) {
+    if (index >= PRESET_BANKS) return;
+    host_flash[index] = *preset;
+    host_flash_writes++;
+}
+
+void load_preset_from_flash(u8 index, preset_data_t *preset) {
+    if (index < PRESET_BANKS) *preset = host_flash[index];
+}
+
+void store_preset_index(u8 index) {
+    host_flash_index = index;
+    host_flash_writes++;
+}
+
+u8 get_preset_index(void) {
+    return host_flash_index;
+}
+
+void set_as_i2c_leader(void) {
+}
+
+void set_as_i2c_follower(u8 address) {
+}
+
+void send_i2c(u8 address, u8 *data, u8 length) {
+}
+
+void print_int(const char *str, s32 value) {
+    printf("%s: %d\n", str, value);
+}
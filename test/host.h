@@ -0,0 +1,44 @@
+// ----------------------------------------------------------------------------
+// host side stand-in for multipass main.c and the module hardware
+//
+// keeps simulated time, runs the timers control.c sets up, records what goes
+// to the outputs, grid and flash, and feeds events into process_event()
+// ----------------------------------------------------------------------------
+
+#pragma once
+#include "types.h"
+#include "control.h"
+
+#define HOST_TIMERS 8
+
+extern u64 host_time;           // simulated ms
+extern u8 host_ext_clock;       // a cable is in the clock jack
+extern u8 host_arc;             // an arc is connected
+extern u16 host_knob;
+
+extern u8 host_gates;           // outputs currently high
+extern u8 host_fired;           // outputs that went high since last cleared
+extern u32 host_ticks;          // clock output pulses
+extern u32 host_led_writes;
+extern u32 host_flash_writes;
+
+// render_grid() time, in ns of host time
+extern u32 host_renders;
+extern u32 host_render_worst;
+extern u64 host_render_total;
+
+extern preset_data_t host_flash[PRESET_BANKS];
+extern u8 host_flash_index;
+
+void host_init(void);
+void host_boot(void);
+void host_run(u32 ms);
+void host_clock_edge(void);
+void host_press(u8 x, u8 y, u8 on);
+void host_tap(u8 x, u8 y);
+void host_hold(u8 x, u8 y);
+void host_front(void);
+void host_arc_turn(u8 enc, u8 dir);
+void host_i2c(u8 *data, u8 length);
+void host_midi_note(u8 channel, u8 note, u8 velocity);
+u64 host_ns(void);
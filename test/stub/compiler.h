@@ -0,0 +1,8 @@
+// host stand-in for the avr32 compiler.h, the cycle counter counts
+// nanoseconds of host time instead
+
+#pragma once
+#include "types.h"
+
+u32 host_cycles(void);
+#define Get_sys_count() host_cycles()
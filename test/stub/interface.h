@@ -0,0 +1,64 @@
+// host stand-in for multipass' interface.h, only what control.c uses.
+// implemented in host.c
+
+#pragma once
+#include "types.h"
+#include "control.h"
+
+enum {
+    MAIN_CLOCK_RECEIVED,
+    MAIN_CLOCK_SWITCHED,
+    GATE_RECEIVED,
+    GRID_CONNECTED,
+    GRID_KEY_PRESSED,
+    GRID_KEY_HELD,
+    ARC_ENCODER_COARSE,
+    FRONT_BUTTON_PRESSED,
+    FRONT_BUTTON_HELD,
+    BUTTON_PRESSED,
+    I2C_RECEIVED,
+    TIMED_EVENT,
+    MIDI_CONNECTED,
+    MIDI_NOTE,
+    MIDI_CC,
+    MIDI_AFTERTOUCH,
+    SHNTH_BAR,
+    SHNTH_ANTENNA,
+    SHNTH_BUTTON
+};
+
+// timers
+void add_timed_event(u8 index, u16 interval, u8 repeat);
+void stop_timed_event(u8 index);
+void update_timer_interval(u8 index, u16 interval);
+u64 get_global_time(void);
+
+// inputs and outputs
+void set_gate(u8 index, u8 on);
+void set_clock_output(u8 on);
+u8 is_external_clock_connected(void);
+u8 get_knob_count(void);
+u16 get_knob_value(u8 index);
+
+// grid and arc
+u8 is_grid_connected(void);
+void set_grid_led(u8 x, u8 y, u8 level);
+void refresh_grid(void);
+u8 is_arc_connected(void);
+void set_arc_led(u8 enc, u8 led, u8 level);
+void refresh_arc(void);
+
+// flash
+void store_shared_data_to_flash(shared_data_t *shared);
+void store_preset_to_flash(u8 index, preset_meta_t *meta, preset_data_t *preset);
+void load_preset_from_flash(u8 index, preset_data_t *preset);
+void store_preset_index(u8 index);
+u8 get_preset_index(void);
+
+// i2c
+void set_as_i2c_leader(void);
+void set_as_i2c_follower(u8 address);
+void send_i2c(u8 address, u8 *data, u8 length);
+
+// debug
+void print_int(const char *str, s32 value);